@@ -7,7 +7,13 @@
 //
 
 #import "BOStringMaker.h"
+#import "BOStringScope.h"
 #import "BOStringAttribute.h"
+#import "BOStringLazyAttributedString.h"
+#import "BOStringGrammar.h"
+#import "BOStringCatalog.h"
+#import "BOStringTrace.h"
+#import "BOStringChromeTraceSink.h"
 
 #import "NSString+BOString.h"
 #import "NSAttributedString+BOString.h"
@@ -10,6 +10,10 @@
 
 /**
  *  Represents single attribute instance.
+ *
+ *  <BOStringMaker> stores attributes as plain records, an instance of this
+ *  class returned by an attribute setter is a view of a single record. It may
+ *  be kept and modified later, i.e. after other attributes are added.
  */
 @interface BOStringAttribute : NSObject
 
@@ -30,6 +34,13 @@
  *  Value of the attribute.
  */
 @property (nonatomic, strong) id attributeValue;
+/**
+ *  Priority of the attribute. In case of conflicts between attributes with the
+ *  same name, an attribute with a higher priority wins. Attributes with equal
+ *  priorities are resolved by call order: the last one wins.
+ *  Default is 0 or a priority set with maker's `priority` block.
+ */
+@property (nonatomic, assign) NSInteger attributePriority;
 
 /**
  *  Semantic filler. Does nothing, just returns self. May be helpful in case if
@@ -50,6 +61,15 @@
  *  Sets range of the attribute.
  */
 - (instancetype (^)(NSRange))range;
+/**
+ *  Sets priority of the attribute.
+ *
+ *	make.foregroundColor([UIColor blueColor]).priority(1).range(NSMakeRange(1, 2));
+ *	make.foregroundColor([UIColor redColor]);
+ *
+ *  Characters (1, 2) stay blue, although red color is set later.
+ */
+- (instancetype (^)(NSInteger))priority;
 /**
  *  Sets range of the attribute to whole string. Equivalent:
  *
@@ -7,8 +7,139 @@
 //
 
 #import "BOStringAttribute.h"
+#import "BOStringAttributeArena.h"
 
 @implementation BOStringAttribute
+{
+    BOStringAttributeArena *_arena;
+    id _owner; // keeps the arena alive
+    pthread_mutex_t *_lock; // guards the arena, if it's shared between threads
+    NSUInteger _recordIndex;
+    NSUInteger _generation; // generation of the arena the record was added in
+    // Storage of an attribute, which was created without arena.
+    BOStringAttributeRecord _record;
+    NSString *_name;
+    id _value;
+}
+
+@synthesize stringLength = _stringLength;
+
+- (instancetype)initWithArena:(BOStringAttributeArena *)arena
+                        owner:(id)owner
+                         lock:(pthread_mutex_t *)lock
+                  recordIndex:(NSUInteger)recordIndex
+                 stringLength:(NSUInteger)stringLength
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _arena = arena;
+    _owner = owner;
+    _lock = lock;
+    _recordIndex = recordIndex;
+    _generation = arena->generation;
+    _stringLength = stringLength;
+
+    return self;
+}
+
+// Records may be moved, when the arena grows, so the record must be accessed
+// only between lockRecord and unlockRecord.
+- (BOStringAttributeRecord *)lockRecord
+{
+    if (_lock)
+    {
+        pthread_mutex_lock(_lock);
+    }
+    if (_arena)
+    {
+        NSAssert(_generation == _arena->generation && _recordIndex < _arena->recordsCount, @"Attribute's record has been discarded, attribute can't be changed anymore");
+        return &_arena->records[_recordIndex];
+    }
+    return &_record;
+}
+
+- (void)unlockRecord
+{
+    if (_lock)
+    {
+        pthread_mutex_unlock(_lock);
+    }
+}
+
+- (NSRange)attributeRange
+{
+    NSRange range = [self lockRecord]->range;
+    [self unlockRecord];
+    return range;
+}
+
+- (void)setAttributeRange:(NSRange)attributeRange
+{
+    [self lockRecord]->range = attributeRange;
+    [self unlockRecord];
+}
+
+- (NSString *)attributeName
+{
+    NSString *name = [self lockRecord]->name;
+    [self unlockRecord];
+    return name;
+}
+
+- (void)setAttributeName:(NSString *)attributeName
+{
+    NSString *name = [attributeName copy];
+    BOStringAttributeRecord *record = [self lockRecord];
+    if (_arena)
+    {
+        BOStringAttributeArenaRetain(_arena, name);
+    }
+    else
+    {
+        _name = name;
+    }
+    record->name = name;
+    [self unlockRecord];
+}
+
+- (NSInteger)attributePriority
+{
+    NSInteger priority = [self lockRecord]->priority;
+    [self unlockRecord];
+    return priority;
+}
+
+- (void)setAttributePriority:(NSInteger)attributePriority
+{
+    [self lockRecord]->priority = attributePriority;
+    [self unlockRecord];
+}
+
+- (id)attributeValue
+{
+    id value = [self lockRecord]->value;
+    [self unlockRecord];
+    return value;
+}
+
+- (void)setAttributeValue:(id)attributeValue
+{
+    BOStringAttributeRecord *record = [self lockRecord];
+    if (_arena)
+    {
+        BOStringAttributeArenaRetain(_arena, attributeValue);
+    }
+    else
+    {
+        _value = attributeValue;
+    }
+    record->value = attributeValue;
+    [self unlockRecord];
+}
 
 - (instancetype)with
 {
@@ -18,14 +149,22 @@
 - (void(^)())stringRange
 {
     return ^{
-        _attributeRange = NSMakeRange(0, _stringLength);
+        [self setAttributeRange:NSMakeRange(0, _stringLength)];
+    };
+}
+
+- (instancetype (^)(NSInteger))priority
+{
+    return ^BOStringAttribute *(NSInteger newPriority) {
+        [self setAttributePriority:newPriority];
+        return self;
     };
 }
 
 - (instancetype (^)(NSRange))range
 {
     return ^BOStringAttribute *(NSRange newRange) {
-        _attributeRange = newRange;
+        [self setAttributeRange:newRange];
         return self;
     };
 }
@@ -0,0 +1,165 @@
+//
+//  BOStringAttributeArena.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "BOStringAttribute.h"
+#import "BOStringMaker.h"
+#import "BOStringLazyAttributedString.h"
+
+// Internal header. Not a part of public API.
+
+/**
+ *  Plain record of a single attribute.
+ */
+typedef struct {
+    __unsafe_unretained NSString *name;
+    __unsafe_unretained id value;
+    NSRange range;
+    NSInteger priority;
+    NSUInteger order; // call order, breaks ties between equal priorities
+    NSUInteger suborder; // breaks ties between records replayed at the same order
+} BOStringAttributeRecord;
+
+/**
+ *  Resolved value of a single attribute over a range.
+ */
+typedef struct {
+    __unsafe_unretained NSString *name;
+    __unsafe_unretained id value;
+    NSRange range;
+} BOStringAttributeRun;
+
+/**
+ *  Maker-scoped storage for attribute records and matched ranges.
+ *
+ *  Records and ranges are kept in plain C buffers, which grow geometrically,
+ *  and names and values are retained by a single `CFArray`, so the number of
+ *  allocations made by the arena grows logarithmically with the number of
+ *  records. The only allocation made per attribute is the <BOStringAttribute>
+ *  returned by a setter.
+ *
+ *  Ranges buffer is used as a stack: a rule pushes its matches, applies
+ *  attributes to them and pops them back, so nested rules share the buffer.
+ */
+typedef struct {
+    BOStringAttributeRecord *records;
+    NSUInteger recordsCount;
+    NSUInteger recordsCapacity;
+
+    NSRange *ranges;
+    NSUInteger rangesCount;
+    NSUInteger rangesCapacity;
+
+    CFMutableArrayRef objects;
+    __unsafe_unretained NSString *lastName;
+
+    NSUInteger generation; // incremented when records are discarded
+} BOStringAttributeArena;
+
+void BOStringAttributeArenaInit(BOStringAttributeArena *arena);
+void BOStringAttributeArenaDestroy(BOStringAttributeArena *arena);
+
+/**
+ *  Appends a record and returns its index. Record's order is its index + 1,
+ *  suborder is 0.
+ */
+NSUInteger BOStringAttributeArenaAddRecord(BOStringAttributeArena *arena, NSString *name, id value, NSRange range, NSInteger priority);
+
+/**
+ *  Appends a copy of _record_ with a new _range_ and returns its index. Order
+ *  and suborder are set as in <BOStringAttributeArenaAddRecord>. Name and value
+ *  of _record_ must already be retained by the arena, they are not retained
+ *  again.
+ */
+NSUInteger BOStringAttributeArenaAddRecordCopy(BOStringAttributeArena *arena, const BOStringAttributeRecord *record, NSRange range);
+
+/**
+ *  Keeps _object_ alive for the lifetime of the arena.
+ */
+void BOStringAttributeArenaRetain(BOStringAttributeArena *arena, id object);
+
+/**
+ *  Discards records starting at _recordsCount_. Attributes bound to discarded
+ *  records assert if they are changed afterwards.
+ */
+void BOStringAttributeArenaTruncateRecords(BOStringAttributeArena *arena, NSUInteger recordsCount);
+
+void BOStringAttributeArenaPushRange(BOStringAttributeArena *arena, NSRange range);
+void BOStringAttributeArenaPopRanges(BOStringAttributeArena *arena, NSUInteger rangesCount);
+
+/**
+ *  Resolves conflicts between records. For every attribute name and every
+ *  character the record with the highest priority wins, records with equal
+ *  priorities are resolved by call order: the last one wins.
+ *
+ *  Resolution is a single sweep over sorted range boundaries of each attribute
+ *  name with a heap of active records, so it takes O(n log n) time for n
+ *  records in the worst case.
+ *
+ *  @param runs On return points to a buffer with runs, which the caller must
+ *  free(). Runs are grouped by attribute name, runs of the same name don't
+ *  overlap and are sorted by location.
+ *
+ *  @return Number of runs, at most twice the number of records.
+ */
+NSUInteger BOStringAttributeArenaResolveRuns(BOStringAttributeArena *arena, BOStringAttributeRun **runs);
+
+@interface BOStringAttribute ()
+
+/**
+ *  Returns an attribute, which proxies record at _recordIndex_ of _arena_.
+ *  _owner_ is retained to keep the arena alive as long as the attribute.
+ *  If _lock_ isn't `NULL`, the record is read and changed only while holding
+ *  it, so the arena can be appended to from other threads meanwhile.
+ */
+- (instancetype)initWithArena:(BOStringAttributeArena *)arena
+                        owner:(id)owner
+                         lock:(pthread_mutex_t *)lock
+                  recordIndex:(NSUInteger)recordIndex
+                 stringLength:(NSUInteger)stringLength;
+
+@end
+
+@interface BOStringMaker ()
+
+/**
+ *  Records an attribute for the current range and priority. Subclasses
+ *  override it to record attributes elsewhere, all attribute setters end up
+ *  here.
+ */
+- (BOStringAttribute *)addAttributeWithName:(NSString *)name value:(id)value;
+
+/**
+ *  Returns a setter block, which records an attribute named _name_ with the
+ *  value passed to the block. The maker creates a setter once per name and
+ *  keeps it, so calling an attribute setter doesn't copy a new block.
+ */
+- (id)setterForAttributeName:(NSString *)name;
+
+/**
+ *  Appends records of _arena_ in _range_ keeping their order relative to each
+ *  other. Names and values of _arena_ are kept alive by the maker.
+ */
+- (void)addRecordsOfArena:(BOStringAttributeArena *)arena inRange:(NSRange)range;
+
+@end
+
+@interface BOStringLazyAttributedString ()
+
+/**
+ *  Returns a string with _runs_ on top of attributes of _string_. Takes
+ *  ownership of _runs_ buffer, retains _objects_ to keep names and values of
+ *  runs alive.
+ */
+- (instancetype)initWithAttributedString:(NSAttributedString *)string
+                                    runs:(BOStringAttributeRun *)runs
+                                   count:(NSUInteger)runsCount
+                                 objects:(CFArrayRef)objects;
+
+@end
@@ -0,0 +1,340 @@
+//
+//  BOStringAttributeArena.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringAttributeArena.h"
+
+static const NSUInteger BOStringAttributeArenaInitialCapacity = 64;
+
+static void *BOStringAttributeArenaGrow(void *buffer, NSUInteger *capacity, NSUInteger required, size_t elementSize)
+{
+    if (required <= *capacity)
+    {
+        return buffer;
+    }
+
+    NSUInteger newCapacity = MAX(*capacity, BOStringAttributeArenaInitialCapacity);
+    while (newCapacity < required)
+    {
+        newCapacity *= 2;
+    }
+
+    void *newBuffer = realloc(buffer, newCapacity * elementSize);
+    NSCAssert(newBuffer, @"Can't allocate memory for %lu attributes", (unsigned long)newCapacity);
+    *capacity = newCapacity;
+    return newBuffer;
+}
+
+void BOStringAttributeArenaInit(BOStringAttributeArena *arena)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->objects = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
+}
+
+void BOStringAttributeArenaDestroy(BOStringAttributeArena *arena)
+{
+    free(arena->records);
+    free(arena->ranges);
+    if (arena->objects)
+    {
+        CFRelease(arena->objects);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+void BOStringAttributeArenaRetain(BOStringAttributeArena *arena, id object)
+{
+    if (!object)
+    {
+        return;
+    }
+    CFArrayAppendValue(arena->objects, (__bridge const void *)object);
+}
+
+NSUInteger BOStringAttributeArenaAddRecord(BOStringAttributeArena *arena, NSString *name, id value, NSRange range, NSInteger priority)
+{
+    arena->records = BOStringAttributeArenaGrow(arena->records, &arena->recordsCapacity, arena->recordsCount + 1, sizeof(BOStringAttributeRecord));
+
+    // Attribute names are mostly constants, don't retain the same name for every record.
+    if (name != arena->lastName)
+    {
+        BOStringAttributeArenaRetain(arena, name);
+        arena->lastName = name;
+    }
+    BOStringAttributeArenaRetain(arena, value);
+
+    NSUInteger index = arena->recordsCount++;
+    BOStringAttributeRecord *record = &arena->records[index];
+    record->name = name;
+    record->value = value;
+    record->range = range;
+    record->priority = priority;
+    record->order = index + 1;
+    record->suborder = 0;
+    return index;
+}
+
+NSUInteger BOStringAttributeArenaAddRecordCopy(BOStringAttributeArena *arena, const BOStringAttributeRecord *record, NSRange range)
+{
+    // record may point into the buffer, which is about to be reallocated
+    BOStringAttributeRecord copy = *record;
+    arena->records = BOStringAttributeArenaGrow(arena->records, &arena->recordsCapacity, arena->recordsCount + 1, sizeof(BOStringAttributeRecord));
+
+    NSUInteger index = arena->recordsCount++;
+    copy.range = range;
+    copy.order = index + 1;
+    copy.suborder = 0;
+    arena->records[index] = copy;
+    return index;
+}
+
+void BOStringAttributeArenaTruncateRecords(BOStringAttributeArena *arena, NSUInteger recordsCount)
+{
+    if (recordsCount >= arena->recordsCount)
+    {
+        return;
+    }
+    arena->recordsCount = recordsCount;
+    arena->generation++;
+}
+
+void BOStringAttributeArenaPushRange(BOStringAttributeArena *arena, NSRange range)
+{
+    arena->ranges = BOStringAttributeArenaGrow(arena->ranges, &arena->rangesCapacity, arena->rangesCount + 1, sizeof(NSRange));
+    arena->ranges[arena->rangesCount++] = range;
+}
+
+void BOStringAttributeArenaPopRanges(BOStringAttributeArena *arena, NSUInteger rangesCount)
+{
+    NSCAssert(rangesCount <= arena->rangesCount, @"Can't pop more ranges than pushed");
+    arena->rangesCount -= rangesCount;
+}
+
+typedef struct {
+    NSUInteger nameIndex;
+    NSUInteger position;
+    NSUInteger recordIndex;
+    BOOL isEnd;
+} BOStringAttributeEvent;
+
+static int BOStringAttributeEventCompare(const void *value1, const void *value2)
+{
+    const BOStringAttributeEvent *event1 = value1;
+    const BOStringAttributeEvent *event2 = value2;
+
+    if (event1->nameIndex < event2->nameIndex) return -1;
+    if (event1->nameIndex > event2->nameIndex) return 1;
+
+    // events at the same position are all processed before the next run is
+    // emitted, so their relative order doesn't matter
+    if (event1->position < event2->position) return -1;
+    if (event1->position > event2->position) return 1;
+
+    return 0;
+}
+
+// Stable bottom-up merge sort. Unlike qsort, which has no complexity bound
+// and may degrade to O(n^2), it takes O(n log n) time in the worst case.
+static void BOStringAttributeEventsSort(BOStringAttributeEvent *events, NSUInteger eventsCount)
+{
+    BOStringAttributeEvent *buffer = malloc(MAX(eventsCount, 1) * sizeof(BOStringAttributeEvent));
+    BOStringAttributeEvent *source = events;
+    BOStringAttributeEvent *target = buffer;
+    for (NSUInteger width = 1; width < eventsCount; width *= 2)
+    {
+        for (NSUInteger start = 0; start < eventsCount; start += 2 * width)
+        {
+            NSUInteger middle = MIN(start + width, eventsCount);
+            NSUInteger end = MIN(start + 2 * width, eventsCount);
+            NSUInteger left = start;
+            NSUInteger right = middle;
+            NSUInteger index = start;
+            while (left < middle && right < end)
+            {
+                BOOL takeRight = (BOStringAttributeEventCompare(&source[right], &source[left]) < 0);
+                target[index++] = takeRight ? source[right++] : source[left++];
+            }
+            while (left < middle)
+            {
+                target[index++] = source[left++];
+            }
+            while (right < end)
+            {
+                target[index++] = source[right++];
+            }
+        }
+
+        BOStringAttributeEvent *sorted = target;
+        target = source;
+        source = sorted;
+    }
+
+    if (source != events)
+    {
+        memcpy(events, source, eventsCount * sizeof(BOStringAttributeEvent));
+    }
+    free(buffer);
+}
+
+static BOOL BOStringAttributeRecordIsAbove(const BOStringAttributeRecord *record1, const BOStringAttributeRecord *record2)
+{
+    if (record1->priority != record2->priority)
+    {
+        return record1->priority > record2->priority;
+    }
+    if (record1->order != record2->order)
+    {
+        return record1->order > record2->order;
+    }
+    return record1->suborder > record2->suborder;
+}
+
+static void BOStringAttributeHeapPush(NSUInteger *heap, NSUInteger *heapCount, NSUInteger recordIndex, const BOStringAttributeRecord *records)
+{
+    NSUInteger child = (*heapCount)++;
+    while (child > 0)
+    {
+        NSUInteger parent = (child - 1) / 2;
+        if (!BOStringAttributeRecordIsAbove(&records[recordIndex], &records[heap[parent]]))
+        {
+            break;
+        }
+        heap[child] = heap[parent];
+        child = parent;
+    }
+    heap[child] = recordIndex;
+}
+
+static void BOStringAttributeHeapPop(NSUInteger *heap, NSUInteger *heapCount, const BOStringAttributeRecord *records)
+{
+    NSUInteger recordIndex = heap[--(*heapCount)];
+    NSUInteger parent = 0;
+    while (YES)
+    {
+        NSUInteger child = parent * 2 + 1;
+        if (child >= *heapCount)
+        {
+            break;
+        }
+        if (child + 1 < *heapCount && BOStringAttributeRecordIsAbove(&records[heap[child + 1]], &records[heap[child]]))
+        {
+            child++;
+        }
+        if (!BOStringAttributeRecordIsAbove(&records[heap[child]], &records[recordIndex]))
+        {
+            break;
+        }
+        heap[parent] = heap[child];
+        parent = child;
+    }
+    heap[parent] = recordIndex;
+}
+
+NSUInteger BOStringAttributeArenaResolveRuns(BOStringAttributeArena *arena, BOStringAttributeRun **runs)
+{
+    *runs = NULL;
+    NSUInteger recordsCount = arena->recordsCount;
+    if (recordsCount == 0)
+    {
+        return 0;
+    }
+
+    const BOStringAttributeRecord *records = arena->records;
+    BOStringAttributeEvent *events = malloc(2 * recordsCount * sizeof(BOStringAttributeEvent));
+    NSUInteger *heap = malloc(recordsCount * sizeof(NSUInteger));
+    BOOL *ended = calloc(recordsCount, sizeof(BOOL));
+    BOStringAttributeRun *result = malloc(2 * recordsCount * sizeof(BOStringAttributeRun));
+
+    // names are compared with isEqual:, values are indexes + 1
+    CFMutableDictionaryRef nameIndexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+    __unsafe_unretained NSString *lastName = nil;
+    NSUInteger lastNameIndex = 0;
+
+    NSUInteger eventsCount = 0;
+    for (NSUInteger i = 0; i < recordsCount; i++)
+    {
+        const BOStringAttributeRecord *record = &records[i];
+        if (!record->value || record->range.length == 0)
+        {
+            continue;
+        }
+
+        if (record->name != lastName)
+        {
+            const void *nameIndex = CFDictionaryGetValue(nameIndexes, (__bridge const void *)record->name);
+            if (!nameIndex)
+            {
+                nameIndex = (const void *)(uintptr_t)(CFDictionaryGetCount(nameIndexes) + 1);
+                CFDictionarySetValue(nameIndexes, (__bridge const void *)record->name, nameIndex);
+            }
+            lastName = record->name;
+            lastNameIndex = (NSUInteger)(uintptr_t)nameIndex;
+        }
+
+        events[eventsCount++] = (BOStringAttributeEvent){lastNameIndex, record->range.location, i, NO};
+        events[eventsCount++] = (BOStringAttributeEvent){lastNameIndex, NSMaxRange(record->range), i, YES};
+    }
+    CFRelease(nameIndexes);
+
+    BOStringAttributeEventsSort(events, eventsCount);
+
+    NSUInteger runsCount = 0;
+    NSUInteger event = 0;
+    while (event < eventsCount)
+    {
+        NSUInteger nameIndex = events[event].nameIndex;
+        NSUInteger groupRunsStart = runsCount;
+        NSUInteger heapCount = 0;
+
+        while (event < eventsCount && events[event].nameIndex == nameIndex)
+        {
+            NSUInteger position = events[event].position;
+            for (; event < eventsCount && events[event].nameIndex == nameIndex && events[event].position == position; event++)
+            {
+                if (events[event].isEnd)
+                {
+                    // removed lazily, when it reaches the top of the heap
+                    ended[events[event].recordIndex] = YES;
+                }
+                else
+                {
+                    BOStringAttributeHeapPush(heap, &heapCount, events[event].recordIndex, records);
+                }
+            }
+
+            while (heapCount > 0 && ended[heap[0]])
+            {
+                BOStringAttributeHeapPop(heap, &heapCount, records);
+            }
+
+            if (heapCount == 0)
+            {
+                continue;
+            }
+
+            // active record always has its end event ahead in the same group
+            NSUInteger nextPosition = events[event].position;
+            const BOStringAttributeRecord *top = &records[heap[0]];
+            BOStringAttributeRun *lastRun = (runsCount > groupRunsStart) ? &result[runsCount - 1] : NULL;
+            if (lastRun && lastRun->value == top->value && NSMaxRange(lastRun->range) == position)
+            {
+                lastRun->range.length += nextPosition - position;
+            }
+            else
+            {
+                result[runsCount++] = (BOStringAttributeRun){top->name, top->value, NSMakeRange(position, nextPosition - position)};
+            }
+        }
+    }
+
+    free(events);
+    free(heap);
+    free(ended);
+
+    *runs = result;
+    return runsCount;
+}
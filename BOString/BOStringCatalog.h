@@ -0,0 +1,152 @@
+//
+//  BOStringCatalog.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class BOStringMaker;
+
+/**
+ *  Error domain of errors returned by <BOStringCatalog>.
+ */
+extern NSString * const BOStringCatalogErrorDomain;
+
+/**
+ *  Error codes in `BOStringCatalogErrorDomain`.
+ */
+typedef NS_ENUM(NSInteger, BOStringCatalogError) {
+    /**
+     *  One of `.strings` files can't be read.
+     */
+    BOStringCatalogUnreadableStringsFileError = 1,
+    /**
+     *  Catalog file is truncated, has unknown version or is not a catalog at all.
+     */
+    BOStringCatalogCorruptedFileError
+};
+
+/**
+ *  Precompiled catalog of localized styled strings.
+ *
+ *  Styling hundreds of localized strings at launch means looking up every text
+ *  and running a maker block for it, even though most of them are never shown.
+ *  Catalog moves text lookup to build time and styling to the first access:
+ *
+ *  - at build time <writeCatalogWithStringsFiles:templateNames:toFile:error:>
+ *      merges `.strings` files into a single indexed binary file, where every
+ *      key also refers to a name of a maker template;
+ *
+ *  - at runtime <initWithContentsOfFile:error:> memory-maps that file, so its
+ *      cost doesn't depend on the number of strings. Templates are registered
+ *      by name with <registerTemplate:withName:>;
+ *
+ *  - <stringForKey:> finds a key with binary search and runs its template
+ *      only once, further lookups are served from cache.
+ *
+ *  Example:
+ *
+ *	BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:path error:nil];
+ *	[catalog registerTemplate:^(BOStringMaker *make) {
+ *	    make.font([UIFont boldSystemFontOfSize:17]);
+ *	    make.each.regexpMatch(@"\\d+", 0, ^{
+ *	        make.foregroundColor([UIColor redColor]);
+ *	    });
+ *	} withName:@"title"];
+ *
+ *	label.attributedText = catalog[@"welcome.title"];
+ */
+@interface BOStringCatalog : NSObject
+
+/**
+ * @name Catalog generator
+ */
+
+/**
+ *  Merges `.strings` files into a catalog file.
+ *
+ *  @param stringsFiles       Paths of `.strings` files. In case if several
+ *  files contain the same key, the last one wins.
+ *  @param templateNamesByKey Dictionary `@{key => template name}`. Keys which
+ *  are not in this dictionary are stored without template and returned
+ *  unstyled.
+ *  @param path               Path of catalog file to write.
+ *  @param error              On failure contains an error in
+ *  `BOStringCatalogErrorDomain` or a file writing error.
+ *
+ *  @return `YES` if catalog was written.
+ */
++ (BOOL)writeCatalogWithStringsFiles:(NSArray *)stringsFiles
+                       templateNames:(NSDictionary *)templateNamesByKey
+                              toFile:(NSString *)path
+                               error:(NSError **)error;
+
+/**
+ * @name Initializers
+ */
+
+/**
+ *  Returns a <BOStringCatalog> instance backed by a memory-mapped catalog file.
+ *
+ *  @param path  Path of a file written by
+ *  <writeCatalogWithStringsFiles:templateNames:toFile:error:>.
+ *  @param error On failure contains an error in `BOStringCatalogErrorDomain`
+ *  or a file reading error.
+ *
+ *  @return <BOStringCatalog> instance or `nil` if file can't be mapped or is
+ *  not a valid catalog.
+ */
+- (instancetype)initWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/**
+ * @name Templates
+ */
+
+/**
+ *  Registers a maker block, which styles all strings referring to _name_.
+ *  Cached strings are discarded, so they are restyled on the next lookup.
+ *
+ *  @param block A list of instructions for <BOStringMaker>.
+ *  @param name  Template name, as passed to the generator.
+ */
+- (void)registerTemplate:(void(^)(BOStringMaker *make))block withName:(NSString *)name;
+
+/**
+ * @name Lookup
+ */
+
+/**
+ *  Number of keys in the catalog.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ *  Returns localized text for a key without styling it.
+ *
+ *  @param key Key of the string.
+ *
+ *  @return Localized text or `nil` if catalog doesn't contain _key_.
+ */
+- (NSString *)plainStringForKey:(NSString *)key;
+
+/**
+ *  Returns styled string for a key. Template is run on the first lookup, the
+ *  result is cached.
+ *
+ *  @param key Key of the string.
+ *
+ *  @return `NSAttributedString` instance or `nil` if catalog doesn't contain
+ *  _key_. Strings, which refer to a template that is not registered yet, are
+ *  returned unstyled and are not cached.
+ */
+- (NSAttributedString *)stringForKey:(NSString *)key;
+
+/**
+ *  Subscript equivalent of <stringForKey:>.
+ */
+- (NSAttributedString *)objectForKeyedSubscript:(NSString *)key;
+
+@end
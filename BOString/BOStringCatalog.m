@@ -0,0 +1,362 @@
+//
+//  BOStringCatalog.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringCatalog.h"
+#import "NSString+BOString.h"
+
+NSString * const BOStringCatalogErrorDomain = @"BOStringCatalogErrorDomain";
+
+// File layout (all integers are little-endian):
+//
+//  header | entries table (sorted by UTF-8 bytes of keys) | UTF-8 blob
+//
+// Keys, values and template names are stored in the blob without terminating
+// zeros, entries refer to them by offset and length relative to the blob.
+// Template names are stored once. Template length 0 means "no template".
+static const char BOStringCatalogMagic[4] = {'B', 'O', 'S', 'C'};
+static const uint32_t BOStringCatalogVersion = 1;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t tableOffset;
+    uint32_t blobOffset;
+    uint32_t blobLength;
+} BOStringCatalogHeader;
+
+typedef struct {
+    uint32_t keyOffset;
+    uint32_t keyLength;
+    uint32_t valueOffset;
+    uint32_t valueLength;
+    uint32_t templateOffset;
+    uint32_t templateLength;
+} BOStringCatalogEntry;
+
+static int BOStringCatalogCompareBytes(const void *bytes1, NSUInteger length1, const void *bytes2, NSUInteger length2)
+{
+    int result = memcmp(bytes1, bytes2, MIN(length1, length2));
+    if (result != 0)
+    {
+        return result;
+    }
+
+    if (length1 < length2) return -1;
+    if (length1 > length2) return 1;
+
+    return 0;
+}
+
+static NSError *BOStringCatalogMakeError(BOStringCatalogError code, NSString *description)
+{
+    return [NSError errorWithDomain:BOStringCatalogErrorDomain
+                               code:code
+                           userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+@interface BOStringCatalog ()
+
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, assign) NSUInteger count;
+@property (nonatomic, strong) NSMutableDictionary *templates; // NSString => maker block
+@property (nonatomic, strong) NSCache *cache; // NSString => NSAttributedString
+@property (nonatomic, assign) NSUInteger templatesGeneration; // incremented when a template is registered
+
+@end
+
+@implementation BOStringCatalog
+{
+    const uint8_t *_table;
+    const uint8_t *_blob;
+    uint32_t _blobLength;
+}
+
+#pragma mark - Generator
+
++ (BOOL)writeCatalogWithStringsFiles:(NSArray *)stringsFiles
+                       templateNames:(NSDictionary *)templateNamesByKey
+                              toFile:(NSString *)path
+                               error:(NSError **)error
+{
+    NSMutableDictionary *strings = [NSMutableDictionary dictionary];
+    for (NSString *stringsFile in stringsFiles)
+    {
+        NSDictionary *fileStrings = [NSDictionary dictionaryWithContentsOfFile:stringsFile];
+        if (!fileStrings)
+        {
+            if (error)
+            {
+                *error = BOStringCatalogMakeError(BOStringCatalogUnreadableStringsFileError,
+                                                  [NSString stringWithFormat:@"Can't read strings file %@", stringsFile]);
+            }
+            return NO;
+        }
+        [strings addEntriesFromDictionary:fileStrings];
+    }
+
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:[strings count]];
+    for (NSString *key in strings)
+    {
+        [keys addObject:[key dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    [keys sortUsingComparator:^NSComparisonResult(NSData *key1, NSData *key2) {
+        int result = BOStringCatalogCompareBytes([key1 bytes], [key1 length], [key2 bytes], [key2 length]);
+        if (result < 0) return NSOrderedAscending;
+        if (result > 0) return NSOrderedDescending;
+        return NSOrderedSame;
+    }];
+
+    NSMutableData *table = [NSMutableData dataWithCapacity:[keys count] * sizeof(BOStringCatalogEntry)];
+    NSMutableData *blob = [NSMutableData data];
+    NSMutableDictionary *templateOffsets = [NSMutableDictionary dictionary];
+    for (NSData *keyData in keys)
+    {
+        NSString *key = [[NSString alloc] initWithData:keyData encoding:NSUTF8StringEncoding];
+        NSData *valueData = [[strings[key] description] dataUsingEncoding:NSUTF8StringEncoding];
+        NSData *templateData = [templateNamesByKey[key] dataUsingEncoding:NSUTF8StringEncoding];
+
+        BOStringCatalogEntry entry = {0};
+        entry.keyOffset = NSSwapHostIntToLittle((uint32_t)[blob length]);
+        entry.keyLength = NSSwapHostIntToLittle((uint32_t)[keyData length]);
+        [blob appendData:keyData];
+
+        entry.valueOffset = NSSwapHostIntToLittle((uint32_t)[blob length]);
+        entry.valueLength = NSSwapHostIntToLittle((uint32_t)[valueData length]);
+        [blob appendData:valueData];
+
+        if ([templateData length] > 0)
+        {
+            NSNumber *templateOffset = templateOffsets[templateData];
+            if (!templateOffset)
+            {
+                templateOffset = @([blob length]);
+                templateOffsets[templateData] = templateOffset;
+                [blob appendData:templateData];
+            }
+            entry.templateOffset = NSSwapHostIntToLittle([templateOffset unsignedIntValue]);
+            entry.templateLength = NSSwapHostIntToLittle((uint32_t)[templateData length]);
+        }
+
+        [table appendBytes:&entry length:sizeof(entry)];
+    }
+
+    BOStringCatalogHeader header = {{0}};
+    memcpy(header.magic, BOStringCatalogMagic, sizeof(header.magic));
+    header.version = NSSwapHostIntToLittle(BOStringCatalogVersion);
+    header.count = NSSwapHostIntToLittle((uint32_t)[keys count]);
+    header.tableOffset = NSSwapHostIntToLittle((uint32_t)sizeof(header));
+    header.blobOffset = NSSwapHostIntToLittle((uint32_t)(sizeof(header) + [table length]));
+    header.blobLength = NSSwapHostIntToLittle((uint32_t)[blob length]);
+
+    NSMutableData *catalog = [NSMutableData dataWithCapacity:sizeof(header) + [table length] + [blob length]];
+    [catalog appendBytes:&header length:sizeof(header)];
+    [catalog appendData:table];
+    [catalog appendData:blob];
+
+    return [catalog writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+#pragma mark - Runtime
+
+- (instancetype)initWithContentsOfFile:(NSString *)path error:(NSError **)error
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+    if (!_data)
+    {
+        return nil;
+    }
+
+    BOStringCatalogHeader header;
+    if ([_data length] < sizeof(header))
+    {
+        if (error)
+        {
+            *error = BOStringCatalogMakeError(BOStringCatalogCorruptedFileError, @"Catalog file is truncated");
+        }
+        return nil;
+    }
+    [_data getBytes:&header length:sizeof(header)];
+
+    uint64_t count = NSSwapLittleIntToHost(header.count);
+    uint64_t tableOffset = NSSwapLittleIntToHost(header.tableOffset);
+    uint64_t blobOffset = NSSwapLittleIntToHost(header.blobOffset);
+    uint64_t blobLength = NSSwapLittleIntToHost(header.blobLength);
+    if (memcmp(header.magic, BOStringCatalogMagic, sizeof(header.magic)) != 0
+        || NSSwapLittleIntToHost(header.version) != BOStringCatalogVersion
+        || tableOffset + count * sizeof(BOStringCatalogEntry) > [_data length]
+        || blobOffset + blobLength > [_data length])
+    {
+        if (error)
+        {
+            *error = BOStringCatalogMakeError(BOStringCatalogCorruptedFileError, @"File is not a valid catalog");
+        }
+        return nil;
+    }
+
+    _count = (NSUInteger)count;
+    _table = (const uint8_t *)[_data bytes] + tableOffset;
+    _blob = (const uint8_t *)[_data bytes] + blobOffset;
+    _blobLength = (uint32_t)blobLength;
+    _templates = [NSMutableDictionary dictionary];
+    _cache = [[NSCache alloc] init];
+
+    return self;
+}
+
+- (void)registerTemplate:(void(^)(BOStringMaker *make))block withName:(NSString *)name
+{
+    @synchronized(_templates)
+    {
+        _templates[name] = [block copy];
+        _templatesGeneration++;
+        [_cache removeAllObjects];
+    }
+}
+
+- (BOOL)getBlobBytes:(const void **)bytes offset:(uint32_t)offset length:(uint32_t)length
+{
+    if ((uint64_t)offset + length > _blobLength)
+    {
+        return NO;
+    }
+    *bytes = _blob + offset;
+    return YES;
+}
+
+- (BOOL)getEntry:(BOStringCatalogEntry *)entry forKey:(NSString *)key
+{
+    const char *keyBytes = [key UTF8String];
+    if (!keyBytes)
+    {
+        return NO;
+    }
+
+    NSUInteger keyLength = strlen(keyBytes);
+
+    NSUInteger low = 0;
+    NSUInteger high = _count;
+    while (low < high)
+    {
+        NSUInteger middle = low + (high - low) / 2;
+        BOStringCatalogEntry candidate;
+        memcpy(&candidate, _table + middle * sizeof(candidate), sizeof(candidate));
+        candidate.keyOffset = NSSwapLittleIntToHost(candidate.keyOffset);
+        candidate.keyLength = NSSwapLittleIntToHost(candidate.keyLength);
+
+        const void *candidateBytes = NULL;
+        if (![self getBlobBytes:&candidateBytes offset:candidate.keyOffset length:candidate.keyLength])
+        {
+            return NO;
+        }
+
+        int result = BOStringCatalogCompareBytes(keyBytes, keyLength, candidateBytes, candidate.keyLength);
+        if (result == 0)
+        {
+            entry->keyOffset = candidate.keyOffset;
+            entry->keyLength = candidate.keyLength;
+            entry->valueOffset = NSSwapLittleIntToHost(candidate.valueOffset);
+            entry->valueLength = NSSwapLittleIntToHost(candidate.valueLength);
+            entry->templateOffset = NSSwapLittleIntToHost(candidate.templateOffset);
+            entry->templateLength = NSSwapLittleIntToHost(candidate.templateLength);
+            return YES;
+        }
+
+        if (result < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return NO;
+}
+
+- (NSString *)blobStringWithOffset:(uint32_t)offset length:(uint32_t)length
+{
+    const void *bytes = NULL;
+    if (![self getBlobBytes:&bytes offset:offset length:length])
+    {
+        return nil;
+    }
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+- (NSString *)plainStringForKey:(NSString *)key
+{
+    BOStringCatalogEntry entry;
+    if (![self getEntry:&entry forKey:key])
+    {
+        return nil;
+    }
+    return [self blobStringWithOffset:entry.valueOffset length:entry.valueLength];
+}
+
+- (NSAttributedString *)stringForKey:(NSString *)key
+{
+    NSAttributedString *cachedString = [_cache objectForKey:key];
+    if (cachedString)
+    {
+        return cachedString;
+    }
+
+    BOStringCatalogEntry entry;
+    if (![self getEntry:&entry forKey:key])
+    {
+        return nil;
+    }
+
+    NSString *string = [self blobStringWithOffset:entry.valueOffset length:entry.valueLength];
+    if (!string)
+    {
+        return nil;
+    }
+
+    if (entry.templateLength == 0)
+    {
+        NSAttributedString *result = [string bos_makeString:nil];
+        [_cache setObject:result forKey:key];
+        return result;
+    }
+
+    NSString *templateName = [self blobStringWithOffset:entry.templateOffset length:entry.templateLength];
+    void (^template)(BOStringMaker *) = nil;
+    NSUInteger generation = 0;
+    @synchronized(_templates)
+    {
+        template = templateName ? _templates[templateName] : nil;
+        generation = _templatesGeneration;
+    }
+
+    NSAttributedString *result = [string bos_makeString:template];
+    @synchronized(_templates)
+    {
+        // don't cache a string made with a template, which has been replaced meanwhile
+        if (template && generation == _templatesGeneration)
+        {
+            [_cache setObject:result forKey:key];
+        }
+    }
+    return result;
+}
+
+- (NSAttributedString *)objectForKeyedSubscript:(NSString *)key
+{
+    return [self stringForKey:key];
+}
+
+@end
@@ -0,0 +1,46 @@
+//
+//  BOStringChromeTraceSink.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "BOStringTrace.h"
+
+/**
+ *  Trace sink, which writes events in Chrome trace event format, so they can
+ *  be inspected in `chrome://tracing`, Perfetto UI or any other viewer that
+ *  supports this format.
+ *
+ *  Example:
+ *
+ *	BOStringChromeTraceSink *sink = [[BOStringChromeTraceSink alloc] initWithPath:@"/tmp/bostring.json"];
+ *	BOStringTraceSetSink(sink);
+ *	// make strings
+ *	BOStringTraceSetSink(nil);
+ *	[sink close];
+ *
+ *  Every event is written and flushed to the file as it comes, so a trace of
+ *  a process, which was killed before <close>, is still readable.
+ */
+@interface BOStringChromeTraceSink : NSObject <BOStringTraceSink>
+
+/**
+ *  Returns a sink, which writes events into a file.
+ *
+ *  @param path Path of a trace file. Existing file is overwritten.
+ *
+ *  @return <BOStringChromeTraceSink> instance or `nil` if file can't be
+ *  opened.
+ */
+- (instancetype)initWithPath:(NSString *)path;
+
+/**
+ *  Finishes trace file. Events reported after this call are ignored.
+ *  Called automatically when sink is deallocated.
+ */
+- (void)close;
+
+@end
@@ -0,0 +1,104 @@
+//
+//  BOStringChromeTraceSink.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringChromeTraceSink.h"
+#import <pthread.h>
+#import <unistd.h>
+
+static uint64_t BOStringChromeTraceThreadIdentifier(void)
+{
+#if defined(__APPLE__)
+    uint64_t threadIdentifier = 0;
+    pthread_threadid_np(NULL, &threadIdentifier);
+    return threadIdentifier;
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+@implementation BOStringChromeTraceSink
+{
+    FILE *_file;
+    BOOL _hasEvents;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _file = fopen([path fileSystemRepresentation], "w");
+    if (!_file)
+    {
+        return nil;
+    }
+    fputs("[", _file);
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self close];
+}
+
+- (void)close
+{
+    @synchronized(self)
+    {
+        if (_file)
+        {
+            fputs("\n]\n", _file);
+            fclose(_file);
+            _file = NULL;
+        }
+    }
+}
+
+- (void)writeEventWithType:(NSString *)type phase:(BOStringTracePhase)phase rule:(NSString *)rule timestamp:(uint64_t)timestamp
+{
+    NSMutableDictionary *event = [@{@"name": BOStringTracePhaseName(phase),
+                                    @"cat": @"BOString",
+                                    @"ph": type,
+                                    @"ts": @(timestamp),
+                                    @"pid": @(getpid()),
+                                    @"tid": @(BOStringChromeTraceThreadIdentifier())} mutableCopy];
+    if (rule)
+    {
+        event[@"args"] = @{@"rule": rule};
+    }
+    NSData *eventData = [NSJSONSerialization dataWithJSONObject:event options:0 error:nil];
+
+    @synchronized(self)
+    {
+        if (!_file || !eventData)
+        {
+            return;
+        }
+        fputs(_hasEvents ? ",\n" : "\n", _file);
+        fwrite([eventData bytes], 1, [eventData length], _file);
+        // don't keep events in stdio buffer, they would be lost if process is killed
+        fflush(_file);
+        _hasEvents = YES;
+    }
+}
+
+- (void)beginPhase:(BOStringTracePhase)phase rule:(NSString *)rule timestamp:(uint64_t)timestamp
+{
+    [self writeEventWithType:@"B" phase:phase rule:rule timestamp:timestamp];
+}
+
+- (void)endPhase:(BOStringTracePhase)phase rule:(NSString *)rule timestamp:(uint64_t)timestamp
+{
+    [self writeEventWithType:@"E" phase:phase rule:rule timestamp:timestamp];
+}
+
+@end
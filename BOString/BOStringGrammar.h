@@ -0,0 +1,95 @@
+//
+//  BOStringGrammar.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Types of tokens found by <BOStringGrammar>.
+ */
+typedef NS_ENUM(NSInteger, BOStringTokenType) {
+    BOStringKeywordToken = 0,
+    BOStringStringToken,
+    BOStringCommentToken,
+    BOStringNumberToken
+};
+
+/**
+ *  Declarative description of a programming language for syntax highlighting.
+ *
+ *  On the first use grammar is compiled into a state machine: keywords into a
+ *  trie, comments and strings into states with their delimiters. Tokenizer
+ *  then scans a string once from left to right, so its time is linear in the
+ *  length of the string and doesn't depend on the number of keywords.
+ *  Keywords, numbers and delimiters inside of strings and comments are not
+ *  tokens, so they don't "fight" the way overlapping regexp rules do.
+ *
+ *  Example:
+ *
+ *	BOStringGrammar *lua = [[BOStringGrammar alloc] init];
+ *	lua.keywords = @[@"if", @"then", @"else", @"end", @"function", @"local", @"return"];
+ *	lua.lineCommentPrefixes = @[@"--"];
+ *	lua.blockCommentDelimiters = @[@[@"--[[", @"]]"]];
+ *	lua.stringDelimiters = @"\"'";
+ *
+ *  If several delimiters match at the same location, the longest one wins, so
+ *  `--[[` above opens a block comment, not a line comment.
+ *
+ *  @see [BOStringMaker highlight] to apply attributes to tokens.
+ */
+@interface BOStringGrammar : NSObject
+
+/**
+ *  Keywords. Keyword is highlighted only if it's a whole identifier, i.e.
+ *  `for` is not highlighted in `format`. Identifiers consist of letters,
+ *  digits and `_`.
+ */
+@property (nonatomic, copy) NSArray *keywords;
+
+/**
+ *  Prefixes of comments, which last until the end of line, i.e. `@[@"//"]`.
+ */
+@property (nonatomic, copy) NSArray *lineCommentPrefixes;
+
+/**
+ *  Pairs of opening and closing delimiters of block comments, i.e.
+ *  `@[@[@"{-", @"-}"]]`. Block comments are not nested.
+ */
+@property (nonatomic, copy) NSArray *blockCommentDelimiters;
+
+/**
+ *  Characters, which open and close strings, i.e. `@"\"'"`. String is closed
+ *  with the same character it was opened with. Unterminated string lasts
+ *  until the end of line.
+ */
+@property (nonatomic, copy) NSString *stringDelimiters;
+
+/**
+ *  Character, which escapes the next character in strings. Default is `\`.
+ *  Set to 0 to disable escaping.
+ */
+@property (nonatomic, assign) unichar escapeCharacter;
+
+/**
+ *  Whether numbers are tokens. Number starts with a digit, which is not a
+ *  part of an identifier, and lasts while there are letters, digits, `_`
+ *  and `.`, so `0x1F`, `3.5f` and `1e10` are single tokens. Default is `YES`.
+ */
+@property (nonatomic, assign) BOOL highlightsNumbers;
+
+/**
+ *  Scans _string_ and enumerates tokens in order of their location. Tokens
+ *  don't overlap.
+ *
+ *  @param string String to tokenize.
+ *  @param block  Block, which is called for every token. Set `*stop` to `YES`
+ *  to stop tokenizing.
+ */
+- (void)enumerateTokensInString:(NSString *)string
+                     usingBlock:(void (^)(BOStringTokenType type, NSRange range, BOOL *stop))block;
+
+@end
@@ -0,0 +1,419 @@
+//
+//  BOStringGrammar.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringGrammar.h"
+
+typedef NS_ENUM(NSInteger, BOStringGrammarDelimiterKind) {
+    BOStringGrammarLineCommentDelimiter = 0,
+    BOStringGrammarBlockCommentDelimiter,
+    BOStringGrammarStringDelimiter
+};
+
+typedef struct {
+    BOStringGrammarDelimiterKind kind;
+    NSUInteger openOffset; // in _characters
+    NSUInteger openLength;
+    NSUInteger closeOffset;
+    NSUInteger closeLength;
+} BOStringGrammarDelimiter;
+
+typedef struct {
+    NSUInteger firstEdge;
+    BOOL terminal;
+} BOStringGrammarTrieNode;
+
+typedef struct {
+    unichar character;
+    NSUInteger child;
+    NSUInteger nextEdge;
+} BOStringGrammarTrieEdge;
+
+static BOOL BOStringGrammarIsNewline(unichar character)
+{
+    return character == '\n' || character == '\r';
+}
+
+static BOOL BOStringGrammarIsDigit(unichar character)
+{
+    return character >= '0' && character <= '9';
+}
+
+static BOOL BOStringGrammarIsIdentifierCharacter(unichar character)
+{
+    if (character < 128)
+    {
+        return (character >= 'a' && character <= 'z')
+            || (character >= 'A' && character <= 'Z')
+            || BOStringGrammarIsDigit(character)
+            || character == '_';
+    }
+    return [[NSCharacterSet alphanumericCharacterSet] characterIsMember:character];
+}
+
+@interface BOStringGrammar ()
+
+@property (nonatomic, assign, getter = isCompiled) BOOL compiled;
+@property (nonatomic, strong) NSMutableData *characters; // unichar, delimiters
+@property (nonatomic, strong) NSMutableData *delimiters; // BOStringGrammarDelimiter
+@property (nonatomic, strong) NSMutableData *nodes; // BOStringGrammarTrieNode, root is 0
+@property (nonatomic, strong) NSMutableData *edges; // BOStringGrammarTrieEdge
+
+@end
+
+@implementation BOStringGrammar
+{
+    // bit is set if an ASCII character opens at least one delimiter
+    uint64_t _openingCharacters[2];
+    BOOL _hasNonASCIIOpeningCharacters;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _escapeCharacter = '\\';
+    _highlightsNumbers = YES;
+
+    return self;
+}
+
+#pragma mark - Properties
+
+- (void)setKeywords:(NSArray *)keywords
+{
+    @synchronized(self)
+    {
+        _keywords = [keywords copy];
+        _compiled = NO;
+    }
+}
+
+- (void)setLineCommentPrefixes:(NSArray *)lineCommentPrefixes
+{
+    @synchronized(self)
+    {
+        _lineCommentPrefixes = [lineCommentPrefixes copy];
+        _compiled = NO;
+    }
+}
+
+- (void)setBlockCommentDelimiters:(NSArray *)blockCommentDelimiters
+{
+    @synchronized(self)
+    {
+        _blockCommentDelimiters = [blockCommentDelimiters copy];
+        _compiled = NO;
+    }
+}
+
+- (void)setStringDelimiters:(NSString *)stringDelimiters
+{
+    @synchronized(self)
+    {
+        _stringDelimiters = [stringDelimiters copy];
+        _compiled = NO;
+    }
+}
+
+#pragma mark - Compilation
+
+- (NSUInteger)appendCharactersOfString:(NSString *)string
+{
+    NSUInteger offset = [_characters length] / sizeof(unichar);
+    NSUInteger length = [string length];
+    [_characters increaseLengthBy:length * sizeof(unichar)];
+    [string getCharacters:(unichar *)[_characters mutableBytes] + offset range:NSMakeRange(0, length)];
+    return offset;
+}
+
+- (void)addDelimiterWithKind:(BOStringGrammarDelimiterKind)kind open:(NSString *)open close:(NSString *)close
+{
+    if ([open length] == 0)
+    {
+        return;
+    }
+
+    BOStringGrammarDelimiter delimiter = {0};
+    delimiter.kind = kind;
+    delimiter.openOffset = [self appendCharactersOfString:open];
+    delimiter.openLength = [open length];
+    delimiter.closeOffset = [self appendCharactersOfString:close];
+    delimiter.closeLength = [close length];
+    [_delimiters appendBytes:&delimiter length:sizeof(delimiter)];
+
+    unichar firstCharacter = [open characterAtIndex:0];
+    if (firstCharacter < 128)
+    {
+        _openingCharacters[firstCharacter / 64] |= (1ULL << (firstCharacter % 64));
+    }
+    else
+    {
+        _hasNonASCIIOpeningCharacters = YES;
+    }
+}
+
+- (void)addKeyword:(NSString *)keyword
+{
+    NSUInteger node = 0;
+    for (NSUInteger i = 0; i < [keyword length]; i++)
+    {
+        unichar character = [keyword characterAtIndex:i];
+        BOStringGrammarTrieNode *nodes = [_nodes mutableBytes];
+        BOStringGrammarTrieEdge *edges = [_edges mutableBytes];
+
+        NSUInteger edge = nodes[node].firstEdge;
+        while (edge != NSNotFound && edges[edge].character != character)
+        {
+            edge = edges[edge].nextEdge;
+        }
+
+        if (edge == NSNotFound)
+        {
+            BOStringGrammarTrieNode child = {NSNotFound, NO};
+            NSUInteger childIndex = [_nodes length] / sizeof(child);
+            [_nodes appendBytes:&child length:sizeof(child)];
+
+            BOStringGrammarTrieEdge newEdge = {character, childIndex, nodes[node].firstEdge};
+            edge = [_edges length] / sizeof(newEdge);
+            [_edges appendBytes:&newEdge length:sizeof(newEdge)];
+
+            // buffers may have been reallocated
+            nodes = [_nodes mutableBytes];
+            nodes[node].firstEdge = edge;
+            edges = [_edges mutableBytes];
+        }
+
+        node = edges[edge].child;
+    }
+
+    ((BOStringGrammarTrieNode *)[_nodes mutableBytes])[node].terminal = YES;
+}
+
+- (void)compileIfNeeded
+{
+    @synchronized(self)
+    {
+        if (_compiled)
+        {
+            return;
+        }
+
+        _characters = [NSMutableData data];
+        _delimiters = [NSMutableData data];
+        memset(_openingCharacters, 0, sizeof(_openingCharacters));
+        _hasNonASCIIOpeningCharacters = NO;
+
+        for (NSString *prefix in _lineCommentPrefixes)
+        {
+            [self addDelimiterWithKind:BOStringGrammarLineCommentDelimiter open:prefix close:@""];
+        }
+
+        for (NSArray *pair in _blockCommentDelimiters)
+        {
+            NSAssert([pair count] == 2, @"Block comment delimiters should be pairs of opening and closing strings");
+            [self addDelimiterWithKind:BOStringGrammarBlockCommentDelimiter open:pair[0] close:pair[1]];
+        }
+
+        for (NSUInteger i = 0; i < [_stringDelimiters length]; i++)
+        {
+            NSString *delimiter = [_stringDelimiters substringWithRange:NSMakeRange(i, 1)];
+            [self addDelimiterWithKind:BOStringGrammarStringDelimiter open:delimiter close:delimiter];
+        }
+
+        BOStringGrammarTrieNode root = {NSNotFound, NO};
+        _nodes = [NSMutableData dataWithBytes:&root length:sizeof(root)];
+        _edges = [NSMutableData data];
+        for (NSString *keyword in _keywords)
+        {
+            [self addKeyword:keyword];
+        }
+
+        _compiled = YES;
+    }
+}
+
+#pragma mark - Tokenizer
+
+static BOOL BOStringGrammarMatches(CFStringInlineBuffer *buffer, NSUInteger length, NSUInteger index, const unichar *characters, NSUInteger charactersLength)
+{
+    if (charactersLength == 0 || index + charactersLength > length)
+    {
+        return NO;
+    }
+
+    for (NSUInteger i = 0; i < charactersLength; i++)
+    {
+        if (CFStringGetCharacterFromInlineBuffer(buffer, (CFIndex)(index + i)) != characters[i])
+        {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (void)enumerateTokensInString:(NSString *)string
+                     usingBlock:(void (^)(BOStringTokenType type, NSRange range, BOOL *stop))block
+{
+    [self compileIfNeeded];
+
+    NSData *characterData = nil;
+    NSData *delimiterData = nil;
+    NSData *nodeData = nil;
+    NSData *edgeData = nil;
+    uint64_t openingCharacters[2];
+    BOOL hasNonASCIIOpeningCharacters = NO;
+    unichar escapeCharacter = 0;
+    BOOL highlightsNumbers = NO;
+    @synchronized(self)
+    {
+        // keep compiled buffers alive, even if grammar is changed meanwhile,
+        // and take the rest of the compiled state from the same compilation
+        characterData = _characters;
+        delimiterData = _delimiters;
+        nodeData = _nodes;
+        edgeData = _edges;
+        memcpy(openingCharacters, _openingCharacters, sizeof(openingCharacters));
+        hasNonASCIIOpeningCharacters = _hasNonASCIIOpeningCharacters;
+        escapeCharacter = _escapeCharacter;
+        highlightsNumbers = _highlightsNumbers;
+    }
+
+    const unichar *characters = [characterData bytes];
+    const BOStringGrammarDelimiter *delimiters = [delimiterData bytes];
+    NSUInteger delimitersCount = [delimiterData length] / sizeof(BOStringGrammarDelimiter);
+    const BOStringGrammarTrieNode *nodes = [nodeData bytes];
+    const BOStringGrammarTrieEdge *edges = [edgeData bytes];
+    BOOL hasKeywords = ([edgeData length] > 0);
+
+    NSUInteger length = [string length];
+    CFStringInlineBuffer buffer;
+    CFStringInitInlineBuffer((__bridge CFStringRef)string, &buffer, CFRangeMake(0, (CFIndex)length));
+
+    BOOL stop = NO;
+    NSUInteger index = 0;
+    while (index < length && !stop)
+    {
+        unichar character = CFStringGetCharacterFromInlineBuffer(&buffer, (CFIndex)index);
+
+        BOOL mayOpen = (character < 128) ? (openingCharacters[character / 64] & (1ULL << (character % 64))) != 0 : hasNonASCIIOpeningCharacters;
+        const BOStringGrammarDelimiter *delimiter = NULL;
+        for (NSUInteger i = 0; mayOpen && i < delimitersCount; i++)
+        {
+            if ((!delimiter || delimiters[i].openLength > delimiter->openLength)
+                && BOStringGrammarMatches(&buffer, length, index, characters + delimiters[i].openOffset, delimiters[i].openLength))
+            {
+                delimiter = &delimiters[i];
+            }
+        }
+
+        if (delimiter)
+        {
+            NSUInteger end = index + delimiter->openLength;
+            switch (delimiter->kind) {
+                case BOStringGrammarLineCommentDelimiter:
+                    while (end < length && !BOStringGrammarIsNewline(CFStringGetCharacterFromInlineBuffer(&buffer, (CFIndex)end)))
+                    {
+                        end++;
+                    }
+                    break;
+
+                case BOStringGrammarBlockCommentDelimiter:
+                    while (end < length && !BOStringGrammarMatches(&buffer, length, end, characters + delimiter->closeOffset, delimiter->closeLength))
+                    {
+                        end++;
+                    }
+                    end = MIN(end + delimiter->closeLength, length);
+                    break;
+
+                case BOStringGrammarStringDelimiter:
+                {
+                    unichar closeCharacter = characters[delimiter->closeOffset];
+                    while (end < length)
+                    {
+                        unichar stringCharacter = CFStringGetCharacterFromInlineBuffer(&buffer, (CFIndex)end);
+                        if (BOStringGrammarIsNewline(stringCharacter))
+                        {
+                            break;
+                        }
+                        end += (escapeCharacter != 0 && stringCharacter == escapeCharacter) ? 2 : 1;
+                        if (stringCharacter == closeCharacter)
+                        {
+                            break;
+                        }
+                    }
+                    end = MIN(end, length);
+                    break;
+                }
+            }
+
+            block(delimiter->kind == BOStringGrammarStringDelimiter ? BOStringStringToken : BOStringCommentToken,
+                  NSMakeRange(index, end - index), &stop);
+            index = end;
+            continue;
+        }
+
+        if (BOStringGrammarIsIdentifierCharacter(character) && !BOStringGrammarIsDigit(character))
+        {
+            // walk keywords trie while scanning identifier
+            NSUInteger node = hasKeywords ? 0 : NSNotFound;
+            NSUInteger end = index;
+            while (end < length)
+            {
+                unichar identifierCharacter = CFStringGetCharacterFromInlineBuffer(&buffer, (CFIndex)end);
+                if (!BOStringGrammarIsIdentifierCharacter(identifierCharacter))
+                {
+                    break;
+                }
+
+                if (node != NSNotFound)
+                {
+                    NSUInteger edge = nodes[node].firstEdge;
+                    while (edge != NSNotFound && edges[edge].character != identifierCharacter)
+                    {
+                        edge = edges[edge].nextEdge;
+                    }
+                    node = (edge != NSNotFound) ? edges[edge].child : NSNotFound;
+                }
+                end++;
+            }
+
+            if (node != NSNotFound && nodes[node].terminal)
+            {
+                block(BOStringKeywordToken, NSMakeRange(index, end - index), &stop);
+            }
+            index = end;
+            continue;
+        }
+
+        if (highlightsNumbers && BOStringGrammarIsDigit(character))
+        {
+            NSUInteger end = index + 1;
+            while (end < length)
+            {
+                unichar numberCharacter = CFStringGetCharacterFromInlineBuffer(&buffer, (CFIndex)end);
+                if (!BOStringGrammarIsIdentifierCharacter(numberCharacter) && numberCharacter != '.')
+                {
+                    break;
+                }
+                end++;
+            }
+
+            block(BOStringNumberToken, NSMakeRange(index, end - index), &stop);
+            index = end;
+            continue;
+        }
+
+        index++;
+    }
+}
+
+@end
@@ -0,0 +1,28 @@
+//
+//  BOStringLazyAttributedString.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Immutable attributed string returned by <[BOStringMaker makeLazyString]>.
+ *
+ *  It keeps the initial string and a table of resolved attribute runs, and
+ *  answers `attributesAtIndex:effectiveRange:` with a binary search in the
+ *  table. Attributes are never written into an `NSMutableAttributedString`,
+ *  so reading a few attributes of a huge document (hit testing, accessibility,
+ *  rendering of a visible part) costs O(log n) per call instead of applying
+ *  all n runs upfront.
+ *
+ *  `copy` returns the same instance, archiving encodes a plain
+ *  `NSAttributedString`. `mutableCopy` and other `NSAttributedString`
+ *  methods, which need every attribute, walk the whole table, so in case if
+ *  you need them often, use <[BOStringMaker makeString]> instead.
+ */
+@interface BOStringLazyAttributedString : NSAttributedString
+
+@end
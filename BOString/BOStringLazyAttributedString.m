@@ -0,0 +1,140 @@
+//
+//  BOStringLazyAttributedString.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringLazyAttributedString.h"
+#import "BOStringAttributeArena.h"
+
+/**
+ *  Runs of a single attribute name. Runs of a group don't overlap and are
+ *  sorted by location.
+ */
+typedef struct {
+    __unsafe_unretained NSString *name;
+    NSUInteger start;
+    NSUInteger count;
+} BOStringLazyRunsGroup;
+
+@implementation BOStringLazyAttributedString
+{
+    NSAttributedString *_base;
+    BOStringAttributeRun *_runs;
+    BOStringLazyRunsGroup *_groups;
+    NSUInteger _groupsCount;
+    CFArrayRef _objects; // keeps names and values of runs alive
+}
+
+- (instancetype)initWithAttributedString:(NSAttributedString *)string
+                                    runs:(BOStringAttributeRun *)runs
+                                   count:(NSUInteger)runsCount
+                                 objects:(CFArrayRef)objects
+{
+    self = [super init];
+    if (!self)
+    {
+        free(runs);
+        return nil;
+    }
+
+    _base = [string copy];
+    _runs = runs;
+    _objects = (CFArrayRef)CFRetain(objects);
+    _groups = malloc(MAX(runsCount, 1) * sizeof(BOStringLazyRunsGroup));
+    for (NSUInteger i = 0; i < runsCount; i++)
+    {
+        BOStringLazyRunsGroup *group = (_groupsCount > 0) ? &_groups[_groupsCount - 1] : NULL;
+        if (group && (group->name == runs[i].name || [group->name isEqualToString:runs[i].name]))
+        {
+            group->count++;
+            continue;
+        }
+        _groups[_groupsCount++] = (BOStringLazyRunsGroup){runs[i].name, i, 1};
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_runs);
+    free(_groups);
+    CFRelease(_objects);
+}
+
+- (NSString *)string
+{
+    return [_base string];
+}
+
+- (NSDictionary *)attributesAtIndex:(NSUInteger)location effectiveRange:(NSRangePointer)range
+{
+    NSRange effectiveRange;
+    NSDictionary *baseAttributes = [_base attributesAtIndex:location effectiveRange:&effectiveRange];
+    NSMutableDictionary *attributes = nil;
+
+    for (NSUInteger i = 0; i < _groupsCount; i++)
+    {
+        const BOStringAttributeRun *runs = _runs + _groups[i].start;
+
+        // number of runs, which start at or before location
+        NSUInteger low = 0;
+        NSUInteger high = _groups[i].count;
+        while (low < high)
+        {
+            NSUInteger middle = low + (high - low) / 2;
+            if (runs[middle].range.location <= location)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        if (low > 0 && NSLocationInRange(location, runs[low - 1].range))
+        {
+            if (!attributes)
+            {
+                attributes = [baseAttributes mutableCopy];
+            }
+            attributes[runs[low - 1].name] = runs[low - 1].value;
+            effectiveRange = NSIntersectionRange(effectiveRange, runs[low - 1].range);
+            continue;
+        }
+
+        // location is in a gap between runs, attribute keeps its base value there
+        NSUInteger gapStart = (low > 0) ? NSMaxRange(runs[low - 1].range) : 0;
+        NSUInteger gapEnd = (low < _groups[i].count) ? runs[low].range.location : [self length];
+        effectiveRange = NSIntersectionRange(effectiveRange, NSMakeRange(gapStart, gapEnd - gapStart));
+    }
+
+    if (range)
+    {
+        *range = effectiveRange;
+    }
+    return attributes ?: baseAttributes;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+// Archives are decoded as a regular attributed string, so they don't depend on
+// the private run table and can be read by code, which doesn't link BOString.
+- (Class)classForCoder
+{
+    return [NSAttributedString class];
+}
+
+- (Class)classForKeyedArchiver
+{
+    return [NSAttributedString class];
+}
+
+@end
@@ -7,6 +7,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "BOStringGrammar.h"
 @class BOStringAttribute;
 
 #if TARGET_OS_IPHONE
@@ -33,32 +34,34 @@
  *	    make.backgroundColor([UIColor blueColor]).range(NSMakeRange(0, 3));
  *	}];
  *
- *  Attributes are stored as <BOStringAttribute> objects in the internal array.
- *  After all attributes are processed, <makeString> method resolves collisions
- *  with the following algorithm:
- *
- *  - it maps array of <BOStringAttribute> objects into a dictionary:   
- *
- *		@{NSRange => @[@{attribute name => attribute value}, ...], ...}
- *
- *      in this example `attribute name` is an `NSAttributedString` attribute name
- *      i.e. `NSFontAttributeName`, `attribute value` is it's value, i.e. `UIFont`
- *      instance.
- *
- *  - it sorts all the attributes by their `NSRange`s, so that ranges with the
- *      same start indexes and longer length have priority over the ones with a
- *      shorter range.
- *
- *  - it applies all attributes with 
- *      `[NSMutableAttributedString addAttributes:range:]` method.
- *
- *  With this algorithm attributes are applied from left to right, so in case if
- *  you write something like:
+ *  Attributes are stored as plain records in the maker's internal buffer.
+ *  Every attribute setter returns its own <BOStringAttribute>, a view of the
+ *  added record, which may be kept to change its range or priority later,
+ *  i.e. after other attributes are added. After all attributes are processed,
+ *  <makeString> method resolves collisions between attributes with the same
+ *  name:
+ *
+ *  - an attribute with a higher priority wins. By default all attributes have
+ *      priority 0, it can be changed with `priority` block or with
+ *      <[BOStringAttribute priority]>;
+ *
+ *  - attributes with equal priorities are resolved by call order: the last
+ *      one wins.
+ *
+ *  Conflicts are resolved with a single sweep over sorted attribute ranges,
+ *  which takes O(n log n) time for n attributes in the worst case. Resolved
+ *  runs don't overlap and are applied with
+ *  `[NSMutableAttributedString addAttribute:value:range:]` method. So in case
+ *  if you write something like:
  *  
  *	make.foregroundColor([UIColor blueColor]).range(NSMakeRange(1, 2));
  *	make.foregroundColor([UIColor redColor]).stringRange();
  *  
- *  it makes sure that `redColor` will be applied first and `blueColor` second.
+ *  the whole string is red. In order to keep characters (1, 2) blue, either
+ *  set red color first, or give blue color a higher priority:
+ *  
+ *	make.foregroundColor([UIColor blueColor]).priority(1).range(NSMakeRange(1, 2));
+ *	make.foregroundColor([UIColor redColor]).stringRange();
  */
 @interface BOStringMaker : NSObject
 
@@ -97,6 +100,82 @@
  */
 - (NSAttributedString *)makeString;
 
+/**
+ *  Returns `NSAttributedString` instance, which doesn't apply attributes
+ *  upfront. Conflicts are resolved the same way as in <makeString>, but the
+ *  result is kept as a table of runs and attributes are looked up there when
+ *  they are requested.
+ *
+ *  Use it for huge strings, when only a few attributes are read, i.e. for hit
+ *  testing or accessibility. Result doesn't change, if the maker is used
+ *  afterwards.
+ *
+ *  @return <BOStringLazyAttributedString> instance.
+ */
+- (NSAttributedString *)makeLazyString;
+
+/**
+ * @name Visible range styling
+ */
+
+/**
+ *  Part of a string, which `each` rules are applied to. Default is the whole
+ *  string. Should be set before any attribute is added, use
+ *  <extendActiveWindow:> afterwards.
+ *
+ *  Example:
+ *
+ *	BOStringMaker *make = [[BOStringMaker alloc] initWithString:hugeText];
+ *	make.activeWindow = visibleRange;
+ *	make.windowMargin = 100;
+ *	make.each.regexpMatch(@"#\\w+", 0, ^{
+ *	    make.foregroundColor([UIColor blueColor]);
+ *	});
+ *	textView.attributedText = [make makeString];
+ *
+ *	// later, when user scrolls
+ *	[make extendActiveWindow:newVisibleRange];
+ *	textView.attributedText = [make makeString];
+ *
+ *  `first` and `last` rules and attributes set with explicit ranges are not
+ *  affected by window.
+ */
+@property (nonatomic, assign) NSRange activeWindow;
+
+/**
+ *  Number of characters around window, which are searched for matches in
+ *  addition to the window. Matches still have to start inside the window, but
+ *  may end in the margin or use it as a context for anchors and lookarounds.
+ *  Should be at least as long as the longest expected match, otherwise matches
+ *  crossing the end of window are not found. Default is 0.
+ */
+@property (nonatomic, assign) NSUInteger windowMargin;
+
+/**
+ *  Maximum number of matches of every `each` rule. Default is 0, which means
+ *  no limit. Can be overridden for a single rule with `limit`.
+ */
+@property (nonatomic, assign) NSUInteger matchLimit;
+
+/**
+ *  Indexes of characters `each` rules have already been applied to.
+ */
+@property (nonatomic, readonly) NSIndexSet *styledIndexes;
+
+/**
+ *  Applies `each` rules added so far to the part of _window_, which is not in
+ *  <styledIndexes> yet. Parts that have been styled already are not searched
+ *  again, matches keep the place of their rule in call order. Call
+ *  <makeString> to get an updated string.
+ *
+ *  Maker keeps rules until the whole string is styled. Rule blocks usually
+ *  capture the maker, so it's not released until then: if you don't need the
+ *  rest of a string, pass `NSMakeRange(0, 0)` to drop the rules.
+ *
+ *  @param window New active window.
+ */
+- (void)extendActiveWindow:(NSRange)window;
+
 /**
  * @name Range modifiers
  */
@@ -166,6 +245,26 @@
  */
 - (void(^)(void (^)(void)))stringRange;
 
+/**
+ *  Returns a block, which should contain attributes with a given priority.
+ *
+ *  Example:
+ *
+ *	NSAttributedString *result = [@"string" makeString:^(BOStringMaker *make) {
+ *	    make.priority(1, ^{
+ *	        make.first.substring(@"str", ^{
+ *	            make.foregroundColor([UIColor redColor]);
+ *	        });
+ *	    });
+ *	    make.foregroundColor([UIColor greenColor]);
+ *	}];
+ *
+ *  `str` stays red, although green color is set later for the whole string.
+ *
+ *  @see BOStringMaker for more information about conflicts resolution.
+ */
+- (void(^)(NSInteger, void (^)(void)))priority;
+
 /**
  * @name Attributed string helper methods
  */
@@ -224,6 +323,24 @@
  */
 - (instancetype)each;
 
+/**
+ *  Helper method, used after `each` to limit the number of matches of a
+ *  single rule.
+ *
+ *  Example:
+ *
+ *	NSAttributedString *result = [@"abababa" makeString:^(BOStringMaker *make) {
+ *	    make.each.limit(2).substring(@"a", ^{
+ *	        make.foregroundColor([UIColor greenColor]);
+ *	    });
+ *	}];
+ *
+ *  Only first two `a` are green.
+ *
+ *  @return `self`.
+ */
+- (instancetype (^)(NSUInteger))limit;
+
 /**
  *  Method which applies certain attributes to substrings according to rules,
  *  described in `first` and `each` methods.
@@ -275,6 +392,39 @@
  */
 - (void(^)(NSString *, NSRegularExpressionOptions, void (^)(void)))regexpGroup;
 
+/**
+ *  Returns a block, which tokenizes the string with a grammar and applies
+ *  attributes to tokens. Attributes block is called once for every token type,
+ *  not for every token, so attributes should depend only on the type.
+ *
+ *  Example:
+ *
+ *	NSAttributedString *result = [source bos_makeString:^(BOStringMaker *make) {
+ *	    make.font([UIFont fontWithName:@"Menlo" size:12]);
+ *	    make.highlight(lua, ^(BOStringTokenType type) {
+ *	        switch (type) {
+ *	            case BOStringKeywordToken:
+ *	                make.foregroundColor([UIColor purpleColor]);
+ *	                break;
+ *	            case BOStringCommentToken:
+ *	                make.foregroundColor([UIColor greenColor]);
+ *	                break;
+ *	            default:
+ *	                break;
+ *	        }
+ *	    });
+ *	}];
+ *
+ *  Unlike a set of `each.regexpMatch` rules, the string is scanned only once,
+ *  and keywords inside of strings and comments are not highlighted. Ranges set
+ *  on attributes inside of the block are ignored, priorities are kept.
+ *  Highlighting is applied to the whole string, it's not affected by
+ *  <activeWindow>, since tokens depend on everything before them.
+ *
+ *  @see BOStringGrammar
+ */
+- (void(^)(BOStringGrammar *, void (^)(BOStringTokenType)))highlight;
+
 /**
  * @name Attributes
  */
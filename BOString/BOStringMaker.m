@@ -8,6 +8,8 @@
 
 #import "BOStringMaker.h"
 #import "BOStringAttribute.h"
+#import "BOStringAttributeArena.h"
+#import "BOStringTrace.h"
 
 typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
     BOStringMakerUndefinedStringCommand = 0,
@@ -19,13 +21,50 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 @interface BOStringMaker ()
 
 @property (nonatomic, copy) NSMutableAttributedString *attributedString;
-@property (nonatomic, strong) NSMutableArray *attributes; // BOStringAttribute
 @property (nonatomic, assign) NSRange furtherRange;
+@property (nonatomic, assign) NSInteger furtherPriority;
 @property (nonatomic, assign) NSInteger stringLength;
 @property (nonatomic, assign) BOStringMakerStringCommand stringCommand;
+@property (nonatomic, assign) NSUInteger ruleMatchLimit;
+@property (nonatomic, strong) NSIndexSet *passIndexes; // part of a string current rules run in
+@property (nonatomic, strong) NSMutableArray *rules; // BOStringMakerRule
+@property (nonatomic, assign) NSUInteger rulesDepth;
+@property (nonatomic, assign) NSUInteger replayOrder;
+@property (nonatomic, assign) BOOL replaying; // rules are replayed, records take replayOrder
 
 @end
 
+/**
+ *  `each` rule, which is kept to style newly visible parts of a string, when
+ *  active window is extended.
+ */
+@interface BOStringMakerRule : NSObject
+
+@property (nonatomic, copy) NSString *method; // substring, regexpMatch or regexpGroup
+@property (nonatomic, strong) NSRegularExpression *expression;
+@property (nonatomic, assign) BOOL matchGroups;
+@property (nonatomic, copy) void (^attributes)(void);
+@property (nonatomic, assign) NSInteger priority;
+@property (nonatomic, assign) NSUInteger matchLimit;
+@property (nonatomic, assign) NSUInteger matchesCount;
+@property (nonatomic, assign) NSUInteger endOrder; // order of the last record added by the rule
+
+@end
+
+@implementation BOStringMakerRule
+@end
+
+#ifdef BOS_TRACING
+static NSString *BOStringMakerRuleIdentifier(BOStringMakerStringCommand command, NSString *method, NSString *pattern)
+{
+    NSString *commandName = @"each";
+    if (command == BOStringMakerFirstStringCommand) commandName = @"first";
+    if (command == BOStringMakerLastStringCommand) commandName = @"last";
+    
+    return [NSString stringWithFormat:@"%@.%@(%@)", commandName, method, pattern];
+}
+#endif // BOS_TRACING
+
 #if TARGET_OS_IPHONE
 #define IS_IOS7 ([[[UIDevice currentDevice] systemVersion] compare:@"7.0" options:NSNumericSearch] == NSOrderedDescending)
 #define NSAttributeAssert(attr) NSAssert(IS_IOS7, @"Attribute %@ is supported on iOS 7 or later", attr)
@@ -33,6 +72,11 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 #define NSAttributeAssert(...)
 #endif
 @implementation BOStringMaker
+{
+    BOStringAttributeArena _arena;
+    NSMutableIndexSet *_styledIndexes;
+    CFMutableDictionaryRef _setters; // attribute name -> setter block
+}
 
 - (instancetype)initWithString:(NSString *)string
 {
@@ -54,42 +98,23 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
         _furtherRange = NSMakeRange(0, _stringLength);
     }
     
-    _attributes = [NSMutableArray array];
+    _activeWindow = NSMakeRange(0, _stringLength);
+    _styledIndexes = [NSMutableIndexSet indexSetWithIndexesInRange:_activeWindow];
+    _passIndexes = [_styledIndexes copy];
+    _rules = [NSMutableArray array];
+    
+    BOStringAttributeArenaInit(&_arena);
     
     return self;
 }
 
-- (NSDictionary *)attributesByRanges:(NSArray *)attributes
+- (void)dealloc
 {
-    NSMutableDictionary *attributesByRanges = [NSMutableDictionary dictionary];
-    for (BOStringAttribute *attribute in attributes)
+    BOStringAttributeArenaDestroy(&_arena);
+    if (_setters)
     {
-        NSValue *rangeVal = [NSValue valueWithRange:attribute.attributeRange];
-        if (!attributesByRanges[rangeVal])
-        {
-            attributesByRanges[rangeVal] = [NSMutableDictionary dictionary];
-        }
-        attributesByRanges[rangeVal][attribute.attributeName] = attribute.attributeValue;
+        CFRelease(_setters);
     }
-    return attributesByRanges;
-}
-
-- (NSArray *)sortedRangesArray:(NSArray *)arrayToSort
-{
-    NSArray *sortedRanges = [arrayToSort sortedArrayUsingComparator:^NSComparisonResult(id val1, id val2) {
-        NSRange range1 = [val1 rangeValue];
-        NSRange range2 = [val2 rangeValue];
-        
-        if(range1.location < range2.location) return NSOrderedAscending;
-        if(range1.location > range2.location) return NSOrderedDescending;
-        
-        // start point is the same. compare lengths. If longer, then it's attributes should go first
-        if(range1.length > range2.length) return NSOrderedAscending;
-        if(range1.length < range2.length) return NSOrderedDescending;
-        
-        return NSOrderedSame;
-    }];
-    return sortedRanges;
 }
 
 - (NSAttributedString *)makeString
@@ -99,17 +124,46 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
         return nil;
     }
     
-    NSDictionary *attributesByRanges = [self attributesByRanges:_attributes];
-    NSArray *sortedRanges = [self sortedRangesArray:[attributesByRanges allKeys]];
+    BOS_TRACE_BEGIN(BOStringTraceMergePhase, nil);
+    BOStringAttributeRun *runs = NULL;
+    NSUInteger runsCount = BOStringAttributeArenaResolveRuns(&_arena, &runs);
+    BOS_TRACE_END(BOStringTraceMergePhase, nil);
     
+    BOS_TRACE_BEGIN(BOStringTraceAttributesApplicationPhase, nil);
     [_attributedString beginEditing];
-    [sortedRanges enumerateObjectsUsingBlock:^(NSValue *range, NSUInteger idx, BOOL *stop) {
-        [_attributedString addAttributes:attributesByRanges[range]
-                                   range:[range rangeValue]];
-    }];
+    for (NSUInteger i = 0; i < runsCount; i++)
+    {
+        [_attributedString addAttribute:runs[i].name
+                                  value:runs[i].value
+                                  range:runs[i].range];
+    }
     [_attributedString endEditing];
+    free(runs);
+    BOS_TRACE_END(BOStringTraceAttributesApplicationPhase, nil);
+    
+    BOS_TRACE_BEGIN(BOStringTraceFinalCopyPhase, nil);
+    NSAttributedString *result = [[NSAttributedString alloc] initWithAttributedString:_attributedString];
+    BOS_TRACE_END(BOStringTraceFinalCopyPhase, nil);
+    
+    return result;
+}
+
+- (NSAttributedString *)makeLazyString
+{
+    if (!_attributedString)
+    {
+        return nil;
+    }
+    
+    BOS_TRACE_BEGIN(BOStringTraceMergePhase, nil);
+    BOStringAttributeRun *runs = NULL;
+    NSUInteger runsCount = BOStringAttributeArenaResolveRuns(&_arena, &runs);
+    BOS_TRACE_END(BOStringTraceMergePhase, nil);
     
-    return [[NSAttributedString alloc] initWithAttributedString:_attributedString];
+    return [[BOStringLazyAttributedString alloc] initWithAttributedString:_attributedString
+                                                                     runs:runs
+                                                                    count:runsCount
+                                                                  objects:_arena.objects];
 }
 
 - (instancetype)with
@@ -140,39 +194,39 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
     NSAssert(_stringCommand != BOStringMakerUndefinedStringCommand, @"Please provide correct instruction before substring command. I.e. make.each.substring(...) or make.first.substring(...)");
     
     return ^(NSString *string, void (^attrbutes)(void)) {
-        NSMutableArray *ranges = [NSMutableArray array];
-        switch (_stringCommand) {
+        BOStringMakerStringCommand command = _stringCommand;
+        NSUInteger matchLimit = _ruleMatchLimit;
+        _stringCommand = BOStringMakerUndefinedStringCommand;
+        _ruleMatchLimit = 0;
+        
+        NSRange range = NSMakeRange(NSNotFound, 0);
+        switch (command) {
             case BOStringMakerFirstStringCommand:
-                [ranges addObject:[NSValue valueWithRange:[[_attributedString string] rangeOfString:string]]];
+                range = [[_attributedString string] rangeOfString:string];
                 break;
             case BOStringMakerLastStringCommand:
-                [ranges addObject:[NSValue valueWithRange:[[_attributedString string] rangeOfString:string
-                                                                                            options:NSBackwardsSearch]]];
+                range = [[_attributedString string] rangeOfString:string
+                                                          options:NSBackwardsSearch];
                 break;
                 
             case BOStringMakerEachStringCommand:
             {
+                BOS_TRACE_BEGIN(BOStringTraceRegexpCompilationPhase, BOStringMakerRuleIdentifier(command, @"substring", string));
                 NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:string
                                                                                             options:NSRegularExpressionIgnoreMetacharacters
                                                                                               error:nil];
-                
-                NSRange range = NSMakeRange(0, [_attributedString length]);
-                [expression enumerateMatchesInString:[_attributedString string]
-                                             options:0
-                                               range:range
-                                          usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-                    [ranges addObject:[NSValue valueWithRange:[result rangeAtIndex:0]]];
-                }];
+                BOS_TRACE_END(BOStringTraceRegexpCompilationPhase, BOStringMakerRuleIdentifier(command, @"substring", string));
+                [self addRuleWithExpression:expression method:@"substring" matchGroups:NO matchLimit:matchLimit attributes:attrbutes];
                 break;
             }
             default:
                 break;
         }
-        _stringCommand = BOStringMakerUndefinedStringCommand;
         
-        [ranges enumerateObjectsUsingBlock:^(NSValue *rangeVal, NSUInteger idx, BOOL *stop) {
-            self.range([rangeVal rangeValue], attrbutes);
-        }];
+        if (range.location != NSNotFound)
+        {
+            [self applyAttributes:attrbutes inRange:range];
+        }
     };
 }
 
@@ -180,31 +234,7 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 {
     NSAssert(_stringCommand != BOStringMakerUndefinedStringCommand, @"Please provide correct instruction before regexp command. I.e. make.each.regexpMatch(...) or make.first.regexpMatch(...)");
     return ^(NSString *pattern, NSRegularExpressionOptions options, void (^attrbutes)(void)) {
-        NSError *error = nil;
-        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern
-                                                                               options:options
-                                                                                 error:&error];
-        NSString *string = [_attributedString string];
-        BOOL matchFirstOnly = (_stringCommand == BOStringMakerFirstStringCommand);
-        BOOL matchLastOnly = (_stringCommand == BOStringMakerLastStringCommand);
-        __block NSTextCheckingResult *lastResult = nil;
-        _stringCommand = BOStringMakerUndefinedStringCommand;
-        [regex enumerateMatchesInString:string
-                                options:0
-                                  range:NSMakeRange(0, [string length])
-                             usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-                                 lastResult = result;
-                                 if (!matchLastOnly)
-                                 {
-                                     self.range(lastResult.range, attrbutes);
-                                 }
-
-                                 *stop = matchFirstOnly;
-                             }];
-        if (matchLastOnly && lastResult)
-        {
-            self.range(lastResult.range, attrbutes);
-        }
+        [self regexpWithPattern:pattern options:options matchGroups:NO attributes:attrbutes];
     };
 }
 
@@ -212,68 +242,351 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 {
     NSAssert(_stringCommand != BOStringMakerUndefinedStringCommand, @"Please provide correct instruction before regexp command. I.e. make.each.regexpGroup(...) or make.first.regexpGroup(...)");
     return ^(NSString *pattern, NSRegularExpressionOptions options, void (^attrbutes)(void)){
-        NSError *error = nil;
-        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern
-                                                                               options:options
-                                                                                 error:&error];
-        NSString *string = [_attributedString string];
-        BOOL matchFirstOnly = (_stringCommand == BOStringMakerFirstStringCommand);
-        BOOL matchLastOnly = (_stringCommand == BOStringMakerLastStringCommand);
-        __block NSTextCheckingResult *lastResult = nil;
-        _stringCommand = BOStringMakerUndefinedStringCommand;
-        [regex enumerateMatchesInString:string
-                                options:0
-                                  range:NSMakeRange(0, [string length])
-                             usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
-                                 lastResult = result;
-                                 if (!matchLastOnly)
-                                 {
-                                     for (NSUInteger i = 1; i < [result numberOfRanges]; i++)
-                                     {
-                                         self.range([result rangeAtIndex:i], attrbutes);
-                                     }
-                                 }
-                                 *stop = matchFirstOnly;
-                             }];
-        if (matchLastOnly && lastResult)
+        [self regexpWithPattern:pattern options:options matchGroups:YES attributes:attrbutes];
+    };
+}
+
+- (void)regexpWithPattern:(NSString *)pattern
+                  options:(NSRegularExpressionOptions)options
+              matchGroups:(BOOL)matchGroups
+               attributes:(void (^)(void))attributes
+{
+    BOStringMakerStringCommand command = _stringCommand;
+    NSUInteger matchLimit = _ruleMatchLimit;
+    NSString *method = matchGroups ? @"regexpGroup" : @"regexpMatch";
+    _stringCommand = BOStringMakerUndefinedStringCommand;
+    _ruleMatchLimit = 0;
+    
+    BOS_TRACE_BEGIN(BOStringTraceRegexpCompilationPhase, BOStringMakerRuleIdentifier(command, method, pattern));
+    NSError *error = nil;
+    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern
+                                                                           options:options
+                                                                             error:&error];
+    BOS_TRACE_END(BOStringTraceRegexpCompilationPhase, BOStringMakerRuleIdentifier(command, method, pattern));
+    if (command == BOStringMakerEachStringCommand)
+    {
+        [self addRuleWithExpression:regex method:method matchGroups:matchGroups matchLimit:matchLimit attributes:attributes];
+        return;
+    }
+    
+    BOS_TRACE_BEGIN(BOStringTraceMatchEnumerationPhase, BOStringMakerRuleIdentifier(command, method, pattern));
+    NSString *string = [_attributedString string];
+    BOOL matchFirstOnly = (command == BOStringMakerFirstStringCommand);
+    __block NSTextCheckingResult *lastResult = nil;
+    [regex enumerateMatchesInString:string
+                            options:0
+                              range:NSMakeRange(0, [string length])
+                         usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+                             lastResult = result;
+                             *stop = matchFirstOnly;
+                         }];
+    if (lastResult)
+    {
+        [self applyAttributes:attributes toResult:lastResult matchGroups:matchGroups];
+    }
+    BOS_TRACE_END(BOStringTraceMatchEnumerationPhase, BOStringMakerRuleIdentifier(command, method, pattern));
+}
+
+- (void)applyAttributes:(void (^)(void))attributes toResult:(NSTextCheckingResult *)result matchGroups:(BOOL)matchGroups
+{
+    if (!matchGroups)
+    {
+        [self applyAttributes:attributes inRange:[result range]];
+        return;
+    }
+    
+    for (NSUInteger i = 1; i < [result numberOfRanges]; i++)
+    {
+        NSRange range = [result rangeAtIndex:i];
+        if (range.location != NSNotFound)
         {
-            for (NSUInteger i = 1; i < [lastResult numberOfRanges]; i++)
+            [self applyAttributes:attributes inRange:range];
+        }
+    }
+}
+
+- (void)addRuleWithExpression:(NSRegularExpression *)expression
+                       method:(NSString *)method
+                  matchGroups:(BOOL)matchGroups
+                   matchLimit:(NSUInteger)matchLimit
+                   attributes:(void (^)(void))attributes
+{
+    BOStringMakerRule *rule = [[BOStringMakerRule alloc] init];
+    rule.method = method;
+    rule.expression = expression;
+    rule.matchGroups = matchGroups;
+    rule.attributes = attributes;
+    rule.priority = _furtherPriority;
+    rule.matchLimit = matchLimit ?: (_matchLimit ?: NSUIntegerMax);
+    
+    [self runRule:rule];
+    rule.endOrder = _arena.recordsCount;
+    
+    // top level rules are replayed when window is extended, nested ones are
+    // run again by their parent rule
+    if (_rulesDepth == 0 && ![self isWholeStringStyled])
+    {
+        [_rules addObject:rule];
+    }
+}
+
+- (void)runRule:(BOStringMakerRule *)rule
+{
+    NSString *string = [_attributedString string];
+    NSUInteger matchLimit = rule.matchLimit;
+    BOOL matchGroups = rule.matchGroups;
+    __block NSUInteger matchesCount = rule.matchesCount;
+    _rulesDepth++;
+    BOS_TRACE_BEGIN(BOStringTraceMatchEnumerationPhase, BOStringMakerRuleIdentifier(BOStringMakerEachStringCommand, rule.method, rule.expression.pattern));
+    
+    [_passIndexes enumerateRangesUsingBlock:^(NSRange region, BOOL *stopRegions) {
+        if (matchesCount >= matchLimit)
+        {
+            *stopRegions = YES;
+            return;
+        }
+        
+        // matches may start only inside the region, margin just gives them
+        // context, so every match is found in exactly one region
+        NSUInteger location = (region.location > _windowMargin) ? region.location - _windowMargin : 0;
+        NSUInteger end = MIN(NSMaxRange(region) + _windowMargin, [string length]);
+        
+        // matches are pushed to the arena, so nested rules can reuse its buffer;
+        // lookarounds, \b and anchors see the text around the searched range,
+        // so a window starting mid-word doesn't produce matches of its own
+        NSUInteger rangesStart = _arena.rangesCount;
+        [rule.expression enumerateMatchesInString:string
+                                          options:NSMatchingWithTransparentBounds | NSMatchingWithoutAnchoringBounds
+                                            range:NSMakeRange(location, end - location)
+                                       usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+            if (!NSLocationInRange([result range].location, region))
+            {
+                *stop = ([result range].location >= NSMaxRange(region));
+                return;
+            }
+            
+            if (!matchGroups)
+            {
+                BOStringAttributeArenaPushRange(&self->_arena, [result range]);
+            }
+            for (NSUInteger i = 1; matchGroups && i < [result numberOfRanges]; i++)
             {
-                self.range([lastResult rangeAtIndex:i], attrbutes);
+                if ([result rangeAtIndex:i].location != NSNotFound)
+                {
+                    BOStringAttributeArenaPushRange(&self->_arena, [result rangeAtIndex:i]);
+                }
             }
+            
+            matchesCount++;
+            *stop = (matchesCount >= matchLimit);
+        }];
+        
+        NSUInteger rangesCount = _arena.rangesCount - rangesStart;
+        for (NSUInteger i = 0; i < rangesCount; i++)
+        {
+            // buffer may be reallocated by nested rules, so don't keep pointers to it
+            [self applyAttributes:rule.attributes inRange:_arena.ranges[rangesStart + i]];
         }
+        BOStringAttributeArenaPopRanges(&_arena, rangesCount);
+    }];
+    
+    BOS_TRACE_END(BOStringTraceMatchEnumerationPhase, BOStringMakerRuleIdentifier(BOStringMakerEachStringCommand, rule.method, rule.expression.pattern));
+    _rulesDepth--;
+    rule.matchesCount = matchesCount;
+}
+
+- (BOOL)isWholeStringStyled
+{
+    return (_stringLength == 0 || [_styledIndexes containsIndexesInRange:NSMakeRange(0, _stringLength)]);
+}
+
+- (void)setActiveWindow:(NSRange)activeWindow
+{
+    NSAssert(_arena.recordsCount == 0 && [_rules count] == 0, @"Active window should be set before any attribute. Use extendActiveWindow: afterwards.");
+    
+    _activeWindow = NSIntersectionRange(activeWindow, NSMakeRange(0, _stringLength));
+    _styledIndexes = [NSMutableIndexSet indexSetWithIndexesInRange:_activeWindow];
+    _passIndexes = [_styledIndexes copy];
+}
+
+- (NSIndexSet *)styledIndexes
+{
+    return [_styledIndexes copy];
+}
+
+- (void)extendActiveWindow:(NSRange)window
+{
+    NSRange activeWindow = NSIntersectionRange(window, NSMakeRange(0, _stringLength));
+    NSMutableIndexSet *newIndexes = [NSMutableIndexSet indexSetWithIndexesInRange:activeWindow];
+    [newIndexes removeIndexes:_styledIndexes];
+    _activeWindow = activeWindow;
+    if (activeWindow.length == 0)
+    {
+        [_rules removeAllObjects];
+        return;
+    }
+    
+    if ([newIndexes count] == 0)
+    {
+        return;
+    }
+    
+    [_styledIndexes addIndexes:newIndexes];
+    NSInteger savedPriority = _furtherPriority;
+    _passIndexes = newIndexes;
+    _replaying = YES;
+    for (BOStringMakerRule *rule in _rules)
+    {
+        // new matches keep the place of their rule in call order, a rule
+        // without matches before the first record has order 0
+        _replayOrder = rule.endOrder;
+        _furtherPriority = rule.priority;
+        [self runRule:rule];
+    }
+    _replaying = NO;
+    _replayOrder = 0;
+    _furtherPriority = savedPriority;
+    // rules added afterwards run over everything styled so far
+    _passIndexes = [_styledIndexes copy];
+    
+    if ([self isWholeStringStyled])
+    {
+        // rules hold attribute blocks, which usually capture the maker
+        [_rules removeAllObjects];
+    }
+}
+
+- (instancetype (^)(NSUInteger))limit
+{
+    return ^BOStringMaker *(NSUInteger limit) {
+        _ruleMatchLimit = limit;
+        return self;
     };
 }
 
 - (void(^)(void (^)(void)))stringRange
 {
     return ^(void (^rangeAttributes)(void)) {
-        self.range(NSMakeRange(0, [[_attributedString string] length]), rangeAttributes);
+        [self applyAttributes:rangeAttributes inRange:NSMakeRange(0, [[_attributedString string] length])];
     };
 }
 
 - (void(^)(NSRange, void (^)(void)))range
 {
     return ^(NSRange range, void (^rangeAttributes)(void)) {
-        NSRange savedRange = _furtherRange;
-        _furtherRange = range;
-        rangeAttributes();
-        _furtherRange = savedRange;
+        [self applyAttributes:rangeAttributes inRange:range];
+    };
+}
+
+- (void(^)(NSInteger, void (^)(void)))priority
+{
+    return ^(NSInteger priority, void (^priorityAttributes)(void)) {
+        NSInteger savedPriority = _furtherPriority;
+        _furtherPriority = priority;
+        priorityAttributes();
+        _furtherPriority = savedPriority;
+    };
+}
+
+- (void(^)(BOStringGrammar *, void (^)(BOStringTokenType)))highlight
+{
+    NSAssert(_stringCommand == BOStringMakerUndefinedStringCommand, @"highlight can't be used after first/last/each command");
+
+    return ^(BOStringGrammar *grammar, void (^tokenAttributes)(BOStringTokenType)) {
+        // attributes of every token type are recorded only once, then their
+        // records are copied for every token of that type
+        NSUInteger tokenTypesCount = BOStringNumberToken + 1;
+        NSUInteger templatesBounds[BOStringNumberToken + 2];
+        NSUInteger *templatesStart = templatesBounds; // arrays can't be captured by blocks
+        NSUInteger firstTemplate = _arena.recordsCount;
+        for (NSUInteger type = 0; type < tokenTypesCount; type++)
+        {
+            templatesStart[type] = _arena.recordsCount - firstTemplate;
+            [self applyAttributes:^{
+                tokenAttributes((BOStringTokenType)type);
+            } inRange:NSMakeRange(0, 0)];
+        }
+        templatesStart[tokenTypesCount] = _arena.recordsCount - firstTemplate;
+
+        // names and values of templates stay retained by the arena
+        NSUInteger templatesCount = templatesStart[tokenTypesCount];
+        BOStringAttributeRecord *templates = malloc(MAX(templatesCount, 1) * sizeof(BOStringAttributeRecord));
+        if (templatesCount > 0)
+        {
+            memcpy(templates, _arena.records + firstTemplate, templatesCount * sizeof(BOStringAttributeRecord));
+        }
+        BOStringAttributeArenaTruncateRecords(&_arena, firstTemplate);
+
+        BOS_TRACE_BEGIN(BOStringTraceMatchEnumerationPhase, @"highlight");
+        BOStringAttributeArena *arena = &_arena;
+        [grammar enumerateTokensInString:[_attributedString string]
+                              usingBlock:^(BOStringTokenType type, NSRange range, BOOL *stop) {
+            for (NSUInteger i = templatesStart[type]; i < templatesStart[type + 1]; i++)
+            {
+                BOStringAttributeArenaAddRecordCopy(arena, &templates[i], range);
+            }
+        }];
+        BOS_TRACE_END(BOStringTraceMatchEnumerationPhase, @"highlight");
+
+        free(templates);
     };
 }
 
+- (void)applyAttributes:(void (^)(void))attributes inRange:(NSRange)range
+{
+    NSRange savedRange = _furtherRange;
+    _furtherRange = range;
+    attributes();
+    _furtherRange = savedRange;
+}
+
 - (BOStringAttribute *)addAttributeWithName:(NSString *)name value:(id)value
 {
     NSAssert(_stringCommand == BOStringMakerUndefinedStringCommand, @"You can use first/each command only in conjunction with substring. I.e. make.each.substring(...) or make.first.substring(...)");
     
-    BOStringAttribute *attribute = [[BOStringAttribute alloc] init];
-    attribute.attributeName = name;
-    attribute.attributeValue = value;
-    attribute.attributeRange = _furtherRange;
-    attribute.stringLength = _stringLength;
+    NSUInteger index = BOStringAttributeArenaAddRecord(&_arena, [name copy], value, _furtherRange, _furtherPriority);
+    if (_replaying)
+    {
+        _arena.records[index].order = _replayOrder;
+        _arena.records[index].suborder = index + 1;
+    }
+    
+    return [[BOStringAttribute alloc] initWithArena:&_arena owner:self lock:NULL recordIndex:index stringLength:_stringLength];
+}
+
+- (void)addRecordsOfArena:(BOStringAttributeArena *)arena inRange:(NSRange)range
+{
+    if (range.length == 0)
+    {
+        return;
+    }
     
-    [_attributes addObject:attribute];
-    return attribute;
+    BOStringAttributeArenaRetain(&_arena, (__bridge id)arena->objects);
+    for (NSUInteger i = range.location; i < NSMaxRange(range); i++)
+    {
+        BOStringAttributeArenaAddRecordCopy(&_arena, &arena->records[i], arena->records[i].range);
+    }
+}
+
+- (id)setterForAttributeName:(NSString *)name
+{
+    if (!_setters)
+    {
+        // names are constants, so they are compared by pointer and not retained
+        _setters = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+    }
+    
+    BOStringAttribute *(^setter)(id) = (__bridge id)CFDictionaryGetValue(_setters, (__bridge const void *)name);
+    if (!setter)
+    {
+        // setters are kept by the maker, so they must not retain it
+        __unsafe_unretained BOStringMaker *maker = self;
+        setter = ^BOStringAttribute *(id value) {
+            return [maker addAttributeWithName:name value:value];
+        };
+        CFDictionarySetValue(_setters, (__bridge const void *)name, (__bridge const void *)setter);
+    }
+    return setter;
 }
 
 - (BOStringAttribute *(^)(NSString *, id))attribute
@@ -285,88 +598,64 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 
 - (BOStringAttribute *(^)(BOSFont *))font
 {
-    return ^BOStringAttribute *(BOSFont *font) {
-        return self.attribute(NSFontAttributeName, font);
-    };
+    return [self setterForAttributeName:NSFontAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSParagraphStyle *))paragraphStyle
 {
-    return ^BOStringAttribute *(NSParagraphStyle *paragraphStyle) {
-        return self.attribute(NSParagraphStyleAttributeName, paragraphStyle);
-    };
+    return [self setterForAttributeName:NSParagraphStyleAttributeName];
 }
 
 - (BOStringAttribute *(^)(BOSColor *))foregroundColor
 {
-    return ^BOStringAttribute *(BOSColor *foregroundColor) {
-        return self.attribute(NSForegroundColorAttributeName, foregroundColor);
-    };
+    return [self setterForAttributeName:NSForegroundColorAttributeName];
 }
 
 - (BOStringAttribute *(^)(BOSColor *))backgroundColor
 {
-    return ^BOStringAttribute *(BOSColor *backgroundColor) {
-        return self.attribute(NSBackgroundColorAttributeName, backgroundColor);
-    };
+    return [self setterForAttributeName:NSBackgroundColorAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))ligature
 {
-    return ^BOStringAttribute *(NSNumber *ligature) {
-        return self.attribute(NSLigatureAttributeName, ligature);
-    };
+    return [self setterForAttributeName:NSLigatureAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))kern
 {
-    return ^BOStringAttribute *(NSNumber *kern) {
-        return self.attribute(NSKernAttributeName, kern);
-    };
+    return [self setterForAttributeName:NSKernAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))strikethroughStyle
 {
-    return ^BOStringAttribute *(NSNumber *strikethroughStyle) {
-        return self.attribute(NSStrikethroughStyleAttributeName, strikethroughStyle);
-    };
+    return [self setterForAttributeName:NSStrikethroughStyleAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))underlineStyle
 {
-    return ^BOStringAttribute *(NSNumber *underlineStyle) {
-        return self.attribute(NSUnderlineStyleAttributeName, underlineStyle);
-    };
+    return [self setterForAttributeName:NSUnderlineStyleAttributeName];
 }
 
 
 - (BOStringAttribute *(^)(BOSColor *))strokeColor
 {
-    return ^BOStringAttribute *(BOSColor *strokeColor) {
-        return self.attribute(NSStrokeColorAttributeName, strokeColor);
-    };
+    return [self setterForAttributeName:NSStrokeColorAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))strokeWidth
 {
-    return ^BOStringAttribute *(NSNumber *strokeWidth) {
-        return self.attribute(NSStrokeWidthAttributeName, strokeWidth);
-    };
+    return [self setterForAttributeName:NSStrokeWidthAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSShadow *))shadow
 {
-    return ^BOStringAttribute *(NSShadow *shadow) {
-        return self.attribute(NSShadowAttributeName, shadow);
-    };
+    return [self setterForAttributeName:NSShadowAttributeName];
 }
 
 #if TARGET_OS_IPHONE || MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_7
 - (BOStringAttribute *(^)(NSNumber *))verticalGlyphForm
 {
-    return ^BOStringAttribute *(NSNumber *verticalGlyphForm) {
-        return self.attribute(NSVerticalGlyphFormAttributeName, verticalGlyphForm);
-    };
+    return [self setterForAttributeName:NSVerticalGlyphFormAttributeName];
 }
 #endif // TARGET_OS_IPHONE || MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_7
 
@@ -375,76 +664,64 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 - (BOStringAttribute *(^)(NSString *))textEffect
 {
     NSAttributeAssert(@"NSTextEffectAttributeName");
-    return ^BOStringAttribute *(NSString *textEffect) {
-        return self.attribute(NSTextEffectAttributeName, textEffect);
-    };
+    return [self setterForAttributeName:NSTextEffectAttributeName];
 }
 #endif // TARGET_OS_IPHONE
 
 - (BOStringAttribute *(^)(NSTextAttachment *))attachment
 {
     NSAttributeAssert(@"NSAttachmentAttributeName");
-    return ^BOStringAttribute *(NSTextAttachment *attachment) {
-        return self.attribute(NSAttachmentAttributeName, attachment);
-    };
+    return [self setterForAttributeName:NSAttachmentAttributeName];
 }
 
 - (BOStringAttribute *(^)(id))link
 {
     NSAttributeAssert(@"NSLinkAttributeName");
+    BOStringAttribute *(^setter)(id) = [self setterForAttributeName:NSLinkAttributeName];
     return ^BOStringAttribute *(id link) {
-        NSAssert([link isKindOfClass:[NSURL class]] || [link isKindOfClass:[NSString class]], @"The value of link attribute is an NSURL object (preferred) or an NSString object.");
-        return self.attribute(NSLinkAttributeName, link);
+        NSCAssert([link isKindOfClass:[NSURL class]] || [link isKindOfClass:[NSString class]], @"The value of link attribute is an NSURL object (preferred) or an NSString object.");
+        return setter(link);
     };
 }
 
 - (BOStringAttribute *(^)(NSNumber *))baselineOffset
 {
     NSAttributeAssert(@"NSBaselineOffsetAttributeName");
-    return ^BOStringAttribute *(NSNumber *baselineOffset) {
-        return self.attribute(NSBaselineOffsetAttributeName, baselineOffset);
-    };
+    return [self setterForAttributeName:NSBaselineOffsetAttributeName];
 }
 
 - (BOStringAttribute *(^)(BOSColor *))underlineColor
 {
     NSAttributeAssert(@"NSUnderlineColorAttributeName");
-    return ^BOStringAttribute *(BOSColor *underlineColor) {
-        return self.attribute(NSUnderlineColorAttributeName, underlineColor);
-    };
+    return [self setterForAttributeName:NSUnderlineColorAttributeName];
 }
 
 - (BOStringAttribute *(^)(BOSColor *))strikethroughColor
 {
     NSAttributeAssert(@"NSStrikethroughColorAttributeName");
-    return ^BOStringAttribute *(BOSColor *strikethroughColor) {
-        return self.attribute(NSStrikethroughColorAttributeName, strikethroughColor);
-    };
+    return [self setterForAttributeName:NSStrikethroughColorAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))obliqueness
 {
     NSAttributeAssert(@"NSObliquenessAttributeName");
-    return ^BOStringAttribute *(NSNumber *obliqueness) {
-        return self.attribute(NSObliquenessAttributeName, obliqueness);
-    };
+    return [self setterForAttributeName:NSObliquenessAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))expansion
 {
     NSAttributeAssert(@"NSExpansionAttributeName");
-    return ^BOStringAttribute *(NSNumber *expansion) {
-        return self.attribute(NSExpansionAttributeName, expansion);
-    };
+    return [self setterForAttributeName:NSExpansionAttributeName];
 }
 
 #if TARGET_OS_IPHONE || MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_6
 - (BOStringAttribute *(^)(id))writingDirection
 {
     NSAttributeAssert(@"NSWritingDirectionAttributeName");
+    BOStringAttribute *(^setter)(id) = [self setterForAttributeName:NSWritingDirectionAttributeName];
     return ^BOStringAttribute *(id writingDirection) {
-        NSAssert([writingDirection isKindOfClass:[NSArray class]] || [writingDirection isKindOfClass:[NSNumber class]], @"The value of writingDirection attribute is an NSArray object or an NSNumber object.");
-        return self.attribute(NSWritingDirectionAttributeName, writingDirection);
+        NSCAssert([writingDirection isKindOfClass:[NSArray class]] || [writingDirection isKindOfClass:[NSNumber class]], @"The value of writingDirection attribute is an NSArray object or an NSNumber object.");
+        return setter(writingDirection);
     };
 }
 #endif // TARGET_OS_IPHONE || MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_6
@@ -453,52 +730,38 @@ typedef NS_ENUM(NSInteger, BOStringMakerStringCommand) {
 #if !TARGET_OS_IPHONE
 - (BOStringAttribute *(^)(NSNumber *))superscript
 {
-    return ^BOStringAttribute *(NSNumber *superscript) {
-        return self.attribute(NSSuperscriptAttributeName, superscript);
-    };
+    return [self setterForAttributeName:NSSuperscriptAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSCursor *))cursor
 {
-    return ^BOStringAttribute *(NSCursor *cursor) {
-        return self.attribute(NSCursorAttributeName, cursor);
-    };
+    return [self setterForAttributeName:NSCursorAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSString *))toolTip
 {
-    return ^BOStringAttribute *(NSString *toolTip) {
-        return self.attribute(NSToolTipAttributeName, toolTip);
-    };
+    return [self setterForAttributeName:NSToolTipAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))characterShape
 {
-    return ^BOStringAttribute *(NSNumber *characterShape) {
-        return self.attribute(NSCharacterShapeAttributeName, characterShape);
-    };
+    return [self setterForAttributeName:NSCharacterShapeAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSGlyphInfo *))glyphInfo
 {
-    return ^BOStringAttribute *(NSGlyphInfo *glyphInfo) {
-        return self.attribute(NSGlyphInfoAttributeName, glyphInfo);
-    };
+    return [self setterForAttributeName:NSGlyphInfoAttributeName];
 }
 
 - (BOStringAttribute *(^)(NSNumber *))markedClauseSegment
 {
-    return ^BOStringAttribute *(NSNumber *markedClauseSegment) {
-        return self.attribute(NSMarkedClauseSegmentAttributeName, markedClauseSegment);
-    };
+    return [self setterForAttributeName:NSMarkedClauseSegmentAttributeName];
 }
 
 #if MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_8
 - (BOStringAttribute *(^)(NSTextAlternatives *))textAlternatives
 {
-    return ^BOStringAttribute *(NSTextAlternatives *textAlternatives) {
-        return self.attribute(NSTextAlternativesAttributeName, textAlternatives);
-    };
+    return [self setterForAttributeName:NSTextAlternativesAttributeName];
 }
 #endif // MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_8
 #endif // !TARGET_OS_IPHONE
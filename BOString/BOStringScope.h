@@ -0,0 +1,60 @@
+//
+//  BOStringScope.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringMaker.h"
+
+/**
+ *  Thread-safe flavour of <BOStringMaker>. It supports the same attributes and
+ *  commands, but doesn't keep a "current" range, priority or command in
+ *  mutable state:
+ *
+ *  - `first`, `last`, `each` and `limit` return a new scope, which carries the
+ *      command, so `make.each` can't be broken by another `make.first` called
+ *      in between;
+ *
+ *  - blocks of `range`, `substring` and other commands are run in a nested
+ *      scope, which is attached to the current thread only. Attributes set
+ *      inside of the block on any scope of the same string go to the
+ *      nested scope.
+ *
+ *  Therefore rule recording is reentrant, and independent parts of a rule set
+ *  can be recorded at the same time with `concurrently`:
+ *
+ *	NSAttributedString *result = [source bos_makeScopedString:^(BOStringScope *make) {
+ *	    make.font([UIFont systemFontOfSize:12]);
+ *	    make.concurrently(@[^{
+ *	        make.each.regexpMatch(@"@\\w+", 0, ^{
+ *	            make.foregroundColor([UIColor blueColor]);
+ *	        });
+ *	    }, ^{
+ *	        make.each.regexpMatch(@"#\\w+", 0, ^{
+ *	            make.foregroundColor([UIColor purpleColor]);
+ *	        });
+ *	    }]);
+ *	}];
+ *
+ *  Attributes of every part are recorded separately and merged in the order of
+ *  parts, so the result is the same as if the parts were run one after
+ *  another, no matter which part finishes first.
+ *
+ *  A scope may also be used from several threads without `concurrently`, then
+ *  attributes are recorded in the order threads set them. <BOStringAttribute>
+ *  returned by an attribute setter may be changed from any thread.
+ *  <[BOStringMaker activeWindow]> and <[BOStringMaker extendActiveWindow:]>
+ *  are not supported.
+ */
+@interface BOStringScope : BOStringMaker
+
+/**
+ *  Returns a block, which runs the given blocks concurrently and waits until
+ *  all of them are finished. Every block is run in its own scope, attributes
+ *  are merged in the order of blocks in the array.
+ */
+- (void(^)(NSArray *))concurrently;
+
+@end
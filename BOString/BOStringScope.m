@@ -0,0 +1,430 @@
+//
+//  BOStringScope.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringScope.h"
+#import "BOStringAttribute.h"
+#import "BOStringAttributeArena.h"
+#import <pthread.h>
+
+typedef NS_ENUM(NSInteger, BOStringScopeCommand) {
+    BOStringScopeUndefinedCommand = 0,
+    BOStringScopeFirstCommand,
+    BOStringScopeLastCommand,
+    BOStringScopeEachCommand
+};
+
+/**
+ *  Records of a single part of a rule set. Segments of concurrent parts are
+ *  children of the segment they were started from and are merged in place of
+ *  the `concurrently` call.
+ */
+@interface BOStringScopeSegment : NSObject
+
+- (instancetype)initWithStringLength:(NSUInteger)stringLength;
+- (BOStringAttribute *)addAttributeWithName:(NSString *)name value:(id)value range:(NSRange)range priority:(NSInteger)priority;
+- (NSArray *)addChildren:(NSUInteger)count;
+- (void)addRecordsToMaker:(BOStringMaker *)maker;
+
+@end
+
+@implementation BOStringScopeSegment
+{
+    BOStringAttributeArena _arena;
+    NSUInteger _stringLength;
+    NSMutableArray *_children; // BOStringScopeSegment
+    NSMutableArray *_childrenPositions; // number of records before a child
+    pthread_mutex_t _lock;
+}
+
+- (instancetype)initWithStringLength:(NSUInteger)stringLength
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _stringLength = stringLength;
+    _children = [NSMutableArray array];
+    _childrenPositions = [NSMutableArray array];
+    pthread_mutex_init(&_lock, NULL);
+    BOStringAttributeArenaInit(&_arena);
+
+    return self;
+}
+
+- (void)dealloc
+{
+    BOStringAttributeArenaDestroy(&_arena);
+    pthread_mutex_destroy(&_lock);
+}
+
+- (BOStringAttribute *)addAttributeWithName:(NSString *)name value:(id)value range:(NSRange)range priority:(NSInteger)priority
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger index = BOStringAttributeArenaAddRecord(&_arena, name, value, range, priority);
+    pthread_mutex_unlock(&_lock);
+    // the attribute may be changed while other threads add records
+    return [[BOStringAttribute alloc] initWithArena:&_arena owner:self lock:&_lock recordIndex:index stringLength:_stringLength];
+}
+
+- (NSArray *)addChildren:(NSUInteger)count
+{
+    NSMutableArray *children = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        [children addObject:[[BOStringScopeSegment alloc] initWithStringLength:_stringLength]];
+    }
+
+    pthread_mutex_lock(&_lock);
+    for (BOStringScopeSegment *child in children)
+    {
+        [_children addObject:child];
+        [_childrenPositions addObject:@(_arena.recordsCount)];
+    }
+    pthread_mutex_unlock(&_lock);
+    return children;
+}
+
+- (void)addRecordsToMaker:(BOStringMaker *)maker
+{
+    pthread_mutex_lock(&_lock);
+    NSUInteger start = 0;
+    for (NSUInteger i = 0; i < [_children count]; i++)
+    {
+        NSUInteger position = [_childrenPositions[i] unsignedIntegerValue];
+        [maker addRecordsOfArena:&_arena inRange:NSMakeRange(start, position - start)];
+        [_children[i] addRecordsToMaker:maker];
+        start = position;
+    }
+    [maker addRecordsOfArena:&_arena inRange:NSMakeRange(start, _arena.recordsCount - start)];
+    pthread_mutex_unlock(&_lock);
+}
+
+@end
+
+/**
+ *  Range, priority and destination of attributes. Scope objects keep the frame
+ *  they were created in, blocks of commands are run with a nested frame, which
+ *  lives on the stack and is attached to the current thread.
+ */
+typedef struct {
+    __unsafe_unretained BOStringScope *root;
+    __unsafe_unretained BOStringScopeSegment *segment;
+    NSRange range;
+    NSInteger priority;
+} BOStringScopeFrame;
+
+static pthread_key_t BOStringScopeFrameKey;
+
+@implementation BOStringScope
+{
+    BOStringScope *_root; // keeps the root alive, nil for the root itself
+    NSAttributedString *_string; // root only
+    BOStringScopeSegment *_segment; // root only
+    BOStringScopeFrame _frame;
+    BOStringScopeCommand _command;
+    NSUInteger _limit;
+}
+
++ (void)initialize
+{
+    if (self == [BOStringScope class])
+    {
+        pthread_key_create(&BOStringScopeFrameKey, NULL);
+    }
+}
+
+- (instancetype)initWithAttributedString:(NSAttributedString *)string
+{
+    // storage of BOStringMaker is not used by scopes
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _string = [string copy];
+    NSUInteger stringLength = [[string string] length];
+    _segment = [[BOStringScopeSegment alloc] initWithStringLength:stringLength];
+    _frame.root = self;
+    _frame.segment = _segment;
+    _frame.range = NSMakeRange(0, stringLength);
+
+    return self;
+}
+
+- (instancetype)initWithParentFrame:(BOStringScopeFrame)frame command:(BOStringScopeCommand)command limit:(NSUInteger)limit
+{
+    self = [super init];
+    if (!self)
+    {
+        return nil;
+    }
+
+    _root = frame.root;
+    _frame = frame;
+    _command = command;
+    _limit = limit;
+
+    return self;
+}
+
+- (BOStringMaker *)maker
+{
+    BOStringScope *root = _frame.root;
+    if (!root->_string)
+    {
+        return nil;
+    }
+
+    BOStringMaker *maker = [[BOStringMaker alloc] initWithAttributedString:root->_string];
+    [root->_segment addRecordsToMaker:maker];
+    return maker;
+}
+
+- (NSAttributedString *)makeString
+{
+    return [[self maker] makeString];
+}
+
+- (NSAttributedString *)makeLazyString
+{
+    return [[self maker] makeLazyString];
+}
+
+#pragma mark - Frames
+
+- (NSString *)string
+{
+    return [_frame.root->_string string];
+}
+
+// Frame of the innermost block of this string running on the current thread,
+// or the frame of the scope itself.
+- (BOStringScopeFrame *)currentFrame
+{
+    BOStringScopeFrame *frame = pthread_getspecific(BOStringScopeFrameKey);
+    return (frame && frame->root == _frame.root) ? frame : &_frame;
+}
+
+- (void)runAttributes:(void (^)(void))attributes inFrame:(BOStringScopeFrame)frame
+{
+    void *savedFrame = pthread_getspecific(BOStringScopeFrameKey);
+    pthread_setspecific(BOStringScopeFrameKey, &frame);
+    attributes();
+    pthread_setspecific(BOStringScopeFrameKey, savedFrame);
+}
+
+- (void)runAttributes:(void (^)(void))attributes inRange:(NSRange)range
+{
+    BOStringScopeFrame frame = *[self currentFrame];
+    frame.range = range;
+    [self runAttributes:attributes inFrame:frame];
+}
+
+#pragma mark - Commands
+
+- (instancetype)scopeWithCommand:(BOStringScopeCommand)command limit:(NSUInteger)limit
+{
+    return [[[self class] alloc] initWithParentFrame:*[self currentFrame] command:command limit:limit];
+}
+
+- (instancetype)first
+{
+    return [self scopeWithCommand:BOStringScopeFirstCommand limit:0];
+}
+
+- (instancetype)last
+{
+    return [self scopeWithCommand:BOStringScopeLastCommand limit:0];
+}
+
+- (instancetype)each
+{
+    return [self scopeWithCommand:BOStringScopeEachCommand limit:0];
+}
+
+- (instancetype (^)(NSUInteger))limit
+{
+    return ^BOStringScope *(NSUInteger limit) {
+        return [self scopeWithCommand:_command limit:limit];
+    };
+}
+
+- (void (^)(NSString *, void (^)(void)))substring
+{
+    NSAssert(_command != BOStringScopeUndefinedCommand, @"Please provide correct instruction before substring command. I.e. make.each.substring(...) or make.first.substring(...)");
+
+    return ^(NSString *string, void (^attributes)(void)) {
+        if (_command == BOStringScopeEachCommand)
+        {
+            NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:string
+                                                                                        options:NSRegularExpressionIgnoreMetacharacters
+                                                                                          error:nil];
+            [self runAttributes:attributes forMatchesOfExpression:expression matchGroups:NO];
+            return;
+        }
+
+        NSStringCompareOptions options = (_command == BOStringScopeLastCommand) ? NSBackwardsSearch : 0;
+        NSRange range = [[self string] rangeOfString:string options:options];
+        if (range.location != NSNotFound)
+        {
+            [self runAttributes:attributes inRange:range];
+        }
+    };
+}
+
+- (void(^)(NSString *, NSRegularExpressionOptions, void (^)(void)))regexpMatch
+{
+    NSAssert(_command != BOStringScopeUndefinedCommand, @"Please provide correct instruction before regexp command. I.e. make.each.regexpMatch(...) or make.first.regexpMatch(...)");
+    return ^(NSString *pattern, NSRegularExpressionOptions options, void (^attributes)(void)) {
+        NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:pattern options:options error:nil];
+        [self runAttributes:attributes forMatchesOfExpression:expression matchGroups:NO];
+    };
+}
+
+- (void(^)(NSString *, NSRegularExpressionOptions, void (^)(void)))regexpGroup
+{
+    NSAssert(_command != BOStringScopeUndefinedCommand, @"Please provide correct instruction before regexp command. I.e. make.each.regexpGroup(...) or make.first.regexpGroup(...)");
+    return ^(NSString *pattern, NSRegularExpressionOptions options, void (^attributes)(void)) {
+        NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:pattern options:options error:nil];
+        [self runAttributes:attributes forMatchesOfExpression:expression matchGroups:YES];
+    };
+}
+
+- (void)runAttributes:(void (^)(void))attributes
+forMatchesOfExpression:(NSRegularExpression *)expression
+          matchGroups:(BOOL)matchGroups
+{
+    NSString *string = [self string];
+    BOStringScopeCommand command = _command;
+    NSUInteger matchLimit = (command == BOStringScopeEachCommand) ? (_limit ?: ([_frame.root matchLimit] ?: NSUIntegerMax)) : 1;
+    __block NSUInteger matchesCount = 0;
+    __block NSTextCheckingResult *lastResult = nil;
+
+    void (^runAttributesForResult)(NSTextCheckingResult *) = ^(NSTextCheckingResult *result) {
+        if (!matchGroups)
+        {
+            [self runAttributes:attributes inRange:[result range]];
+            return;
+        }
+        for (NSUInteger i = 1; i < [result numberOfRanges]; i++)
+        {
+            if ([result rangeAtIndex:i].location != NSNotFound)
+            {
+                [self runAttributes:attributes inRange:[result rangeAtIndex:i]];
+            }
+        }
+    };
+
+    [expression enumerateMatchesInString:string
+                                 options:0
+                                   range:NSMakeRange(0, [string length])
+                              usingBlock:^(NSTextCheckingResult *result, NSMatchingFlags flags, BOOL *stop) {
+        if (command == BOStringScopeLastCommand)
+        {
+            lastResult = result;
+            return;
+        }
+
+        runAttributesForResult(result);
+        matchesCount++;
+        *stop = (matchesCount >= matchLimit);
+    }];
+
+    if (lastResult)
+    {
+        runAttributesForResult(lastResult);
+    }
+}
+
+#pragma mark - Range modifiers
+
+- (void(^)(void (^)(void)))stringRange
+{
+    return ^(void (^rangeAttributes)(void)) {
+        [self runAttributes:rangeAttributes inRange:NSMakeRange(0, [[self string] length])];
+    };
+}
+
+- (void(^)(NSRange, void (^)(void)))range
+{
+    return ^(NSRange range, void (^rangeAttributes)(void)) {
+        [self runAttributes:rangeAttributes inRange:range];
+    };
+}
+
+- (void(^)(NSInteger, void (^)(void)))priority
+{
+    return ^(NSInteger priority, void (^priorityAttributes)(void)) {
+        BOStringScopeFrame frame = *[self currentFrame];
+        frame.priority = priority;
+        [self runAttributes:priorityAttributes inFrame:frame];
+    };
+}
+
+- (void(^)(BOStringGrammar *, void (^)(BOStringTokenType)))highlight
+{
+    return ^(BOStringGrammar *grammar, void (^tokenAttributes)(BOStringTokenType)) {
+        BOStringScopeFrame frame = *[self currentFrame];
+        void *savedFrame = pthread_getspecific(BOStringScopeFrameKey);
+        [grammar enumerateTokensInString:[self string] usingBlock:^(BOStringTokenType type, NSRange range, BOOL *stop) {
+            BOStringScopeFrame tokenFrame = frame;
+            tokenFrame.range = range;
+            pthread_setspecific(BOStringScopeFrameKey, &tokenFrame);
+            tokenAttributes(type);
+        }];
+        pthread_setspecific(BOStringScopeFrameKey, savedFrame);
+    };
+}
+
+- (void(^)(NSArray *))concurrently
+{
+    return ^(NSArray *parts) {
+        BOStringScopeFrame frame = *[self currentFrame];
+        NSArray *segments = [frame.segment addChildren:[parts count]];
+        dispatch_apply([parts count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            BOStringScopeFrame partFrame = frame;
+            partFrame.segment = segments[i];
+            [self runAttributes:parts[i] inFrame:partFrame];
+        });
+    };
+}
+
+#pragma mark - Attributes
+
+- (BOStringAttribute *)addAttributeWithName:(NSString *)name value:(id)value
+{
+    NSAssert(_command == BOStringScopeUndefinedCommand, @"You can use first/each command only in conjunction with substring. I.e. make.each.substring(...) or make.first.substring(...)");
+
+    BOStringScopeFrame *frame = [self currentFrame];
+    return [frame->segment addAttributeWithName:[name copy] value:value range:frame->range priority:frame->priority];
+}
+
+- (id)setterForAttributeName:(NSString *)name
+{
+    // setters are not cached, so a scope can be shared between threads
+    return ^BOStringAttribute *(id value) {
+        return [self addAttributeWithName:name value:value];
+    };
+}
+
+#pragma mark - Active window
+
+- (void)setActiveWindow:(NSRange)activeWindow
+{
+    NSAssert(NO, @"Active window is not supported by scopes");
+}
+
+- (void)extendActiveWindow:(NSRange)window
+{
+    NSAssert(NO, @"Active window is not supported by scopes");
+}
+
+@end
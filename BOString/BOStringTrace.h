@@ -0,0 +1,115 @@
+//
+//  BOStringTrace.h
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Phases of making a string, which are reported to <BOStringTraceSink>.
+ */
+typedef NS_ENUM(NSInteger, BOStringTracePhase) {
+    /**
+     *  Maker block is run and attributes are recorded.
+     */
+    BOStringTraceRuleRecordingPhase = 0,
+    /**
+     *  Regular expression of a rule is compiled.
+     */
+    BOStringTraceRegexpCompilationPhase,
+    /**
+     *  Matches of a rule are enumerated and its attributes are recorded.
+     */
+    BOStringTraceMatchEnumerationPhase,
+    /**
+     *  Conflicts between recorded attributes are resolved.
+     */
+    BOStringTraceMergePhase,
+    /**
+     *  Resolved attributes are applied to a mutable attributed string.
+     */
+    BOStringTraceAttributesApplicationPhase,
+    /**
+     *  Result is copied into an immutable attributed string.
+     */
+    BOStringTraceFinalCopyPhase
+};
+
+/**
+ *  Receives begin and end events of <BOStringTracePhase>s. Events of a phase
+ *  are always reported on the same thread and are properly nested, so they
+ *  map directly onto duration events of trace viewers, perf or LTTng.
+ *
+ *  Sink may be called from any thread making strings.
+ *
+ *  @see BOStringChromeTraceSink for a ready-made sink.
+ */
+@protocol BOStringTraceSink <NSObject>
+
+/**
+ *  Phase is started.
+ *
+ *  @param phase     Started phase.
+ *  @param rule      Identifier of a rule, i.e. `each.regexpMatch(\w+)`, or
+ *  `nil` for phases, which don't belong to a single rule.
+ *  @param timestamp Monotonic time in microseconds.
+ */
+- (void)beginPhase:(BOStringTracePhase)phase rule:(NSString *)rule timestamp:(uint64_t)timestamp;
+
+/**
+ *  Phase is finished. Parameters are the same as in the matching
+ *  <beginPhase:rule:timestamp:> call, except of _timestamp_.
+ */
+- (void)endPhase:(BOStringTracePhase)phase rule:(NSString *)rule timestamp:(uint64_t)timestamp;
+
+@end
+
+/**
+ *  Sets a sink, which receives trace events. Pass `nil` to stop tracing. The
+ *  sink may be replaced while strings are being made on other threads, events
+ *  reported at that moment may still go to the previous sink.
+ *
+ *  Trace points are compiled out by default, define `BOS_TRACING` when
+ *  building BOString to enable them. I.e. in Podfile:
+ *
+ *	post_install do |installer|
+ *	  installer.pods_project.targets.each do |target|
+ *	    next unless target.name == 'BOString'
+ *	    target.build_configurations.each do |config|
+ *	      config.build_settings['GCC_PREPROCESSOR_DEFINITIONS'] ||= ['$(inherited)']
+ *	      config.build_settings['GCC_PREPROCESSOR_DEFINITIONS'] << 'BOS_TRACING=1'
+ *	    end
+ *	  end
+ *	end
+ */
+extern void BOStringTraceSetSink(id<BOStringTraceSink> sink);
+
+/**
+ *  Returns current sink or `nil`. The sink is retained by the caller, so it
+ *  stays valid even if another thread replaces it.
+ */
+extern id<BOStringTraceSink> BOStringTraceGetSink(void);
+
+/**
+ *  Returns human readable name of _phase_, i.e. `match enumeration`.
+ */
+extern NSString *BOStringTracePhaseName(BOStringTracePhase phase);
+
+/**
+ *  Returns monotonic time in microseconds.
+ */
+extern uint64_t BOStringTraceTimestamp(void);
+
+extern void BOStringTraceBegin(BOStringTracePhase phase, NSString *rule);
+extern void BOStringTraceEnd(BOStringTracePhase phase, NSString *rule);
+
+#ifdef BOS_TRACING
+#define BOS_TRACE_BEGIN(phase, rule) BOStringTraceBegin(phase, rule)
+#define BOS_TRACE_END(phase, rule) BOStringTraceEnd(phase, rule)
+#else
+#define BOS_TRACE_BEGIN(phase, rule)
+#define BOS_TRACE_END(phase, rule)
+#endif // BOS_TRACING
@@ -0,0 +1,86 @@
+//
+//  BOStringTrace.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+
+#import "BOStringTrace.h"
+#import <pthread.h>
+
+#if defined(__APPLE__)
+#import <mach/mach_time.h>
+#else
+#import <time.h>
+#endif
+
+// guards the sink, so it can't be released while a phase is being reported
+static pthread_mutex_t BOStringTraceSinkLock = PTHREAD_MUTEX_INITIALIZER;
+static id<BOStringTraceSink> BOStringTraceCurrentSink = nil;
+
+void BOStringTraceSetSink(id<BOStringTraceSink> sink)
+{
+    pthread_mutex_lock(&BOStringTraceSinkLock);
+    // previous sink is released after unlocking, its dealloc may take time
+    id<BOStringTraceSink> previousSink = BOStringTraceCurrentSink;
+    BOStringTraceCurrentSink = sink;
+    pthread_mutex_unlock(&BOStringTraceSinkLock);
+    previousSink = nil;
+}
+
+id<BOStringTraceSink> BOStringTraceGetSink(void)
+{
+    pthread_mutex_lock(&BOStringTraceSinkLock);
+    id<BOStringTraceSink> sink = BOStringTraceCurrentSink;
+    pthread_mutex_unlock(&BOStringTraceSinkLock);
+    return sink;
+}
+
+NSString *BOStringTracePhaseName(BOStringTracePhase phase)
+{
+    switch (phase) {
+        case BOStringTraceRuleRecordingPhase:
+            return @"rule recording";
+        case BOStringTraceRegexpCompilationPhase:
+            return @"regexp compilation";
+        case BOStringTraceMatchEnumerationPhase:
+            return @"match enumeration";
+        case BOStringTraceMergePhase:
+            return @"merge";
+        case BOStringTraceAttributesApplicationPhase:
+            return @"attributes application";
+        case BOStringTraceFinalCopyPhase:
+            return @"final copy";
+    }
+    return @"unknown";
+}
+
+uint64_t BOStringTraceTimestamp(void)
+{
+#if defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+    {
+        mach_timebase_info(&timebase);
+    }
+    // multiplication in integers may overflow on devices where numer isn't 1
+    return (uint64_t)((double)mach_absolute_time() * timebase.numer / timebase.denom / 1000);
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000 + (uint64_t)time.tv_nsec / 1000;
+#endif
+}
+
+void BOStringTraceBegin(BOStringTracePhase phase, NSString *rule)
+{
+    id<BOStringTraceSink> sink = BOStringTraceGetSink();
+    [sink beginPhase:phase rule:rule timestamp:BOStringTraceTimestamp()];
+}
+
+void BOStringTraceEnd(BOStringTracePhase phase, NSString *rule)
+{
+    id<BOStringTraceSink> sink = BOStringTraceGetSink();
+    [sink endPhase:phase rule:rule timestamp:BOStringTraceTimestamp()];
+}
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 
 @class BOStringMaker;
+@class BOStringScope;
 
 /**
  *  Helper category, which allows to avoid manual creation of <BOStringMaker>.
@@ -29,6 +30,19 @@
  */
 - (NSAttributedString *)bos_makeString:(void(^)(BOStringMaker *make))block;
 
+/**
+ *  Creates `NSAttributedString` instance with a given block, which can be run
+ *  on several threads at the same time.
+ *
+ *  @param block A list of instructions for <BOStringScope>.
+ *
+ *  @return An `NSAttributedString` instance with attributes added
+ *  from _block_.
+ *
+ *  @see BOStringScope for more information.
+ */
+- (NSAttributedString *)bos_makeScopedString:(void(^)(BOStringScope *make))block;
+
 @end
 
 #ifdef BOS_SHORTHAND
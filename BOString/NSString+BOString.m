@@ -8,6 +8,8 @@
 
 #import "NSString+BOString.h"
 #import "BOStringMaker.h"
+#import "BOStringScope.h"
+#import "BOStringTrace.h"
 
 @implementation NSString (BOString)
 
@@ -16,10 +18,25 @@
     BOStringMaker *stringMaker = [[BOStringMaker alloc] initWithString:self];
     if (block)
     {
+        BOS_TRACE_BEGIN(BOStringTraceRuleRecordingPhase, nil);
         block(stringMaker);
+        BOS_TRACE_END(BOStringTraceRuleRecordingPhase, nil);
     }
     
     return [stringMaker makeString];
 }
 
+- (NSAttributedString *)bos_makeScopedString:(void(^)(BOStringScope *make))block
+{
+    BOStringScope *scope = [[BOStringScope alloc] initWithString:self];
+    if (block)
+    {
+        BOS_TRACE_BEGIN(BOStringTraceRuleRecordingPhase, nil);
+        block(scope);
+        BOS_TRACE_END(BOStringTraceRuleRecordingPhase, nil);
+    }
+    
+    return [scope makeString];
+}
+
 @end
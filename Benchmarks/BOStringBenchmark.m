@@ -0,0 +1,398 @@
+//
+//  BOStringBenchmark.m
+//  BOString
+//
+//  Created by Pavel Mazurin on 19/10/26.
+//  Copyright (c) 2026 Pavel Mazurin. All rights reserved.
+//
+//  Corpus-driven benchmark. Runs every input of a corpus through
+//  bos_makeString: with its template and records throughput, latency
+//  percentiles and allocations into a JSON file, which can be compared
+//  against a stored baseline:
+//
+//      bosbench run Benchmarks/Corpus results.json
+//      bosbench compare baseline.json results.json [threshold]
+//
+
+#import <Foundation/Foundation.h>
+#import "BOString.h"
+
+#import <pthread.h>
+
+#if defined(__APPLE__)
+#import <mach/mach_time.h>
+#else
+#import <time.h>
+#endif
+
+typedef void (^BOStringBenchmarkTemplate)(BOStringMaker *make);
+
+static const double BOStringBenchmarkDefaultThreshold = 0.1;
+
+// with fewer samples p99 is just the slowest run, which is too noisy to compare
+static const NSUInteger BOStringBenchmarkMinimumP99Samples = 100;
+
+static NSDictionary *BOStringBenchmarkTemplates(void)
+{
+    BOSFont *font = [BOSFont systemFontOfSize:12];
+    BOSFont *boldFont = [BOSFont boldSystemFontOfSize:12];
+
+    BOStringBenchmarkTemplate chat = ^(BOStringMaker *make) {
+        make.font(font);
+        make.each.regexpMatch(@"@\\w+", 0, ^{
+            make.foregroundColor([BOSColor blueColor]);
+            make.font(boldFont);
+        });
+        make.each.regexpMatch(@"#\\w+", 0, ^{
+            make.foregroundColor([BOSColor purpleColor]);
+        });
+        make.each.regexpMatch(@"https?://\\S+", 0, ^{
+            make.underlineStyle(@(NSUnderlineStyleSingle));
+            make.foregroundColor([BOSColor blueColor]);
+        });
+    };
+
+    BOStringBenchmarkTemplate source = ^(BOStringMaker *make) {
+        make.font(font);
+        make.each.regexpMatch(@"\\b(if|else|for|while|return|switch|case|default|break|static|const|self)\\b", 0, ^{
+            make.foregroundColor([BOSColor purpleColor]);
+            make.font(boldFont);
+        });
+        make.each.regexpMatch(@"\\b\\d+(\\.\\d+)?\\b", 0, ^{
+            make.foregroundColor([BOSColor blueColor]);
+        });
+        make.priority(1, ^{
+            make.each.regexpMatch(@"@?\"(?:[^\"\\\\]|\\\\.)*\"", 0, ^{
+                make.foregroundColor([BOSColor redColor]);
+            });
+        });
+        make.priority(2, ^{
+            make.each.regexpMatch(@"//.*$", NSRegularExpressionAnchorsMatchLines, ^{
+                make.foregroundColor([BOSColor greenColor]);
+            });
+            make.each.regexpMatch(@"/\\*[\\s\\S]*?\\*/", 0, ^{
+                make.foregroundColor([BOSColor greenColor]);
+            });
+        });
+    };
+
+    BOStringBenchmarkTemplate log = ^(BOStringMaker *make) {
+        make.font(font);
+        make.each.regexpMatch(@"^\\S+", NSRegularExpressionAnchorsMatchLines, ^{
+            make.foregroundColor([BOSColor grayColor]);
+        });
+        make.each.regexpMatch(@"^.*\\bWARN\\b.*$", NSRegularExpressionAnchorsMatchLines, ^{
+            make.backgroundColor([BOSColor yellowColor]);
+        });
+        make.each.regexpMatch(@"^.*\\bERROR\\b.*$", NSRegularExpressionAnchorsMatchLines, ^{
+            make.foregroundColor([BOSColor redColor]);
+        });
+        make.each.regexpGroup(@"\\s(\\d+)ms\\b", 0, ^{
+            make.font(boldFont);
+        });
+    };
+
+    return @{@"chat": chat, @"source": source, @"log": log};
+}
+
+static double BOStringBenchmarkNow(void)
+{
+#if defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+    {
+        mach_timebase_info(&timebase);
+    }
+    return (double)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+#endif
+}
+
+// Counting of malloc calls made by the measuring thread. On OS X malloc
+// reports every allocation to malloc_logger, with glibc malloc, calloc and
+// realloc are interposed. Elsewhere allocations are not measured and
+// allocationsPerRun is left out of results.
+static pthread_t BOStringBenchmarkAllocationsThread;
+static volatile BOOL BOStringBenchmarkCountingAllocations;
+static volatile NSUInteger BOStringBenchmarkAllocationsCount;
+
+static inline void BOStringBenchmarkCountAllocation(void)
+{
+    if (BOStringBenchmarkCountingAllocations && pthread_equal(pthread_self(), BOStringBenchmarkAllocationsThread))
+    {
+        BOStringBenchmarkAllocationsCount++;
+    }
+}
+
+#if defined(__APPLE__)
+#define BOS_BENCHMARK_COUNTS_ALLOCATIONS 1
+
+typedef void (BOStringBenchmarkMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip);
+extern BOStringBenchmarkMallocLogger *malloc_logger;
+
+static void BOStringBenchmarkLogMalloc(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip)
+{
+    // 2 is the "allocate" flag, it's set for malloc, calloc and realloc
+    if (type & 2)
+    {
+        BOStringBenchmarkCountAllocation();
+    }
+}
+#elif defined(__GLIBC__)
+#define BOS_BENCHMARK_COUNTS_ALLOCATIONS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size)
+{
+    BOStringBenchmarkCountAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    BOStringBenchmarkCountAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+    BOStringBenchmarkCountAllocation();
+    return __libc_realloc(pointer, size);
+}
+#else
+#define BOS_BENCHMARK_COUNTS_ALLOCATIONS 0
+#endif
+
+static void BOStringBenchmarkStartCountingAllocations(void)
+{
+    BOStringBenchmarkAllocationsThread = pthread_self();
+    BOStringBenchmarkAllocationsCount = 0;
+    BOStringBenchmarkCountingAllocations = YES;
+#if defined(__APPLE__)
+    malloc_logger = BOStringBenchmarkLogMalloc;
+#endif
+}
+
+// Returns the number of malloc calls since the counting was started.
+static NSUInteger BOStringBenchmarkStopCountingAllocations(void)
+{
+#if defined(__APPLE__)
+    malloc_logger = NULL;
+#endif
+    BOStringBenchmarkCountingAllocations = NO;
+    return BOStringBenchmarkAllocationsCount;
+}
+
+static double BOStringBenchmarkPercentile(NSArray *sortedValues, double percentile)
+{
+    if ([sortedValues count] == 0)
+    {
+        return 0;
+    }
+    NSUInteger index = (NSUInteger)ceil(percentile * [sortedValues count]);
+    index = MIN(MAX(index, 1), [sortedValues count]) - 1;
+    return [sortedValues[index] doubleValue];
+}
+
+static NSString *BOStringBenchmarkLoadInput(NSString *corpusPath, NSDictionary *entry)
+{
+    NSString *path = [corpusPath stringByAppendingPathComponent:entry[@"file"]];
+    NSString *contents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:nil];
+    if ([contents length] == 0)
+    {
+        return contents;
+    }
+
+    // large inputs are generated from a small sample instead of being stored
+    NSUInteger minimumLength = [entry[@"minimumLength"] unsignedIntegerValue];
+    NSMutableString *input = [contents mutableCopy];
+    while ([input length] < minimumLength)
+    {
+        [input appendString:contents];
+    }
+    return input;
+}
+
+static NSDictionary *BOStringBenchmarkRunEntry(NSString *input, BOStringBenchmarkTemplate template, NSUInteger iterations)
+{
+    // warm up regexp caches and fonts
+    [input bos_makeString:template];
+
+    NSMutableArray *latencies = [NSMutableArray arrayWithCapacity:iterations];
+    NSUInteger allocations = 0;
+    double totalTime = 0;
+    for (NSUInteger i = 0; i < iterations; i++)
+    {
+        // latency is measured in a separate run, so counting doesn't affect it
+        @autoreleasepool {
+            double start = BOStringBenchmarkNow();
+            NSAttributedString *result = [input bos_makeString:template];
+            double latency = BOStringBenchmarkNow() - start;
+
+            totalTime += latency;
+            [latencies addObject:@(latency)];
+            (void)result;
+        }
+
+#if BOS_BENCHMARK_COUNTS_ALLOCATIONS
+        @autoreleasepool {
+            BOStringBenchmarkStartCountingAllocations();
+            NSAttributedString *result = [input bos_makeString:template];
+            allocations += BOStringBenchmarkStopCountingAllocations();
+            (void)result;
+        }
+#endif
+    }
+
+    [latencies sortUsingSelector:@selector(compare:)];
+    double megabytes = (double)[input lengthOfBytesUsingEncoding:NSUTF8StringEncoding] * iterations / (1024 * 1024);
+    NSMutableDictionary *result = [@{@"iterations": @(iterations),
+                                     @"inputLength": @([input length]),
+                                     @"throughputMBps": @(totalTime > 0 ? megabytes / totalTime : 0),
+                                     @"p50Ms": @(BOStringBenchmarkPercentile(latencies, 0.5) * 1000)} mutableCopy];
+    if (iterations >= BOStringBenchmarkMinimumP99Samples)
+    {
+        result[@"p99Ms"] = @(BOStringBenchmarkPercentile(latencies, 0.99) * 1000);
+    }
+#if BOS_BENCHMARK_COUNTS_ALLOCATIONS
+    result[@"allocationsPerRun"] = @(iterations > 0 ? allocations / iterations : 0);
+#endif
+    return result;
+}
+
+static int BOStringBenchmarkRun(NSString *corpusPath, NSString *outputPath)
+{
+    NSArray *corpus = [NSArray arrayWithContentsOfFile:[corpusPath stringByAppendingPathComponent:@"corpus.plist"]];
+    if (!corpus)
+    {
+        fprintf(stderr, "Can't read corpus.plist in %s\n", [corpusPath fileSystemRepresentation]);
+        return 2;
+    }
+
+    NSDictionary *templates = BOStringBenchmarkTemplates();
+    NSMutableDictionary *workloads = [NSMutableDictionary dictionary];
+    for (NSDictionary *entry in corpus)
+    {
+        NSString *name = entry[@"name"];
+        NSString *input = BOStringBenchmarkLoadInput(corpusPath, entry);
+        BOStringBenchmarkTemplate template = templates[entry[@"template"]];
+        if (!input || !template)
+        {
+            fprintf(stderr, "Skipping %s: missing input or template\n", [name UTF8String]);
+            continue;
+        }
+
+        NSDictionary *result = BOStringBenchmarkRunEntry(input, template, [entry[@"iterations"] unsignedIntegerValue] ?: 1);
+        workloads[name] = result;
+        NSNumber *p99 = result[@"p99Ms"];
+        NSNumber *allocations = result[@"allocationsPerRun"];
+        printf("%-12s %10.2f MB/s  p50 %9.3f ms  p99 %9s ms  %8s allocs/run\n",
+               [name UTF8String],
+               [result[@"throughputMBps"] doubleValue],
+               [result[@"p50Ms"] doubleValue],
+               p99 ? [[NSString stringWithFormat:@"%.3f", [p99 doubleValue]] UTF8String] : "n/a",
+               allocations ? [[allocations stringValue] UTF8String] : "n/a");
+    }
+
+    NSDictionary *report = @{@"version": @1,
+                             @"date": [[NSDate date] description],
+                             @"workloads": workloads};
+    NSData *reportData = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:nil];
+    if (![reportData writeToFile:outputPath atomically:YES])
+    {
+        fprintf(stderr, "Can't write %s\n", [outputPath fileSystemRepresentation]);
+        return 2;
+    }
+    return 0;
+}
+
+static int BOStringBenchmarkCompare(NSString *baselinePath, NSString *currentPath, double threshold)
+{
+    NSData *baselineData = [NSData dataWithContentsOfFile:baselinePath];
+    NSData *currentData = [NSData dataWithContentsOfFile:currentPath];
+    NSDictionary *baseline = baselineData ? [NSJSONSerialization JSONObjectWithData:baselineData options:0 error:nil][@"workloads"] : nil;
+    NSDictionary *current = currentData ? [NSJSONSerialization JSONObjectWithData:currentData options:0 error:nil][@"workloads"] : nil;
+    if (!baseline || !current)
+    {
+        fprintf(stderr, "Can't read benchmark results\n");
+        return 2;
+    }
+
+    // metric => YES if higher value is better
+    NSDictionary *metrics = @{@"throughputMBps": @YES, @"p50Ms": @NO, @"p99Ms": @NO, @"allocationsPerRun": @NO};
+    NSUInteger regressions = 0;
+    for (NSString *name in [[baseline allKeys] sortedArrayUsingSelector:@selector(compare:)])
+    {
+        NSDictionary *currentResult = current[name];
+        if (!currentResult)
+        {
+            printf("%-12s missing in current results\n", [name UTF8String]);
+            regressions++;
+            continue;
+        }
+
+        for (NSString *metric in [[metrics allKeys] sortedArrayUsingSelector:@selector(compare:)])
+        {
+            NSNumber *baselineNumber = baseline[name][metric];
+            NSNumber *currentNumber = currentResult[metric];
+            if (!baselineNumber || !currentNumber)
+            {
+                // i.e. allocations on a platform where they can't be counted or
+                // p99 of a workload with too few iterations
+                printf("%-12s %-18s not measured in %s\n",
+                       [name UTF8String], [metric UTF8String],
+                       !baselineNumber ? "baseline" : "current results");
+                continue;
+            }
+
+            double baselineValue = [baselineNumber doubleValue];
+            double currentValue = [currentNumber doubleValue];
+            if (baselineValue <= 0)
+            {
+                printf("%-12s %-18s %12.3f -> %12.3f  no relative change from zero\n",
+                       [name UTF8String], [metric UTF8String], baselineValue, currentValue);
+                continue;
+            }
+
+            double change = (currentValue - baselineValue) / baselineValue;
+            BOOL regressed = [metrics[metric] boolValue] ? (change < -threshold) : (change > threshold);
+            printf("%-12s %-18s %12.3f -> %12.3f  %+7.1f%%%s\n",
+                   [name UTF8String], [metric UTF8String], baselineValue, currentValue, change * 100,
+                   regressed ? "  REGRESSION" : "");
+            regressions += regressed ? 1 : 0;
+        }
+    }
+
+    printf("%lu regression(s), threshold %.0f%%\n", (unsigned long)regressions, threshold * 100);
+    return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    @autoreleasepool {
+        NSMutableArray *arguments = [[[NSProcessInfo processInfo] arguments] mutableCopy];
+        [arguments removeObjectAtIndex:0];
+
+        if ([arguments count] == 3 && [arguments[0] isEqualToString:@"run"])
+        {
+            return BOStringBenchmarkRun(arguments[1], arguments[2]);
+        }
+
+        if (([arguments count] == 3 || [arguments count] == 4) && [arguments[0] isEqualToString:@"compare"])
+        {
+            double threshold = ([arguments count] == 4) ? [arguments[3] doubleValue] : BOStringBenchmarkDefaultThreshold;
+            return BOStringBenchmarkCompare(arguments[1], arguments[2], threshold);
+        }
+
+        fprintf(stderr, "usage: bosbench run <corpus directory> <results.json>\n"
+                        "       bosbench compare <baseline.json> <results.json> [threshold, default %.2f]\n",
+                BOStringBenchmarkDefaultThreshold);
+        return 2;
+    }
+}
@@ -19,6 +19,36 @@
     #define IS_IOS7 YES
 #endif
 
+#if defined(__APPLE__)
+#import <pthread.h>
+
+// malloc calls the logger for every allocation while it is set
+typedef void (BOStringTestMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip);
+extern BOStringTestMallocLogger *malloc_logger;
+
+static pthread_t BOStringTestAllocationsThread;
+static volatile NSUInteger BOStringTestAllocationsCount;
+
+static void BOStringTestCountAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip)
+{
+    // 2 is the "allocate" flag, it's set for malloc, calloc and realloc
+    if ((type & 2) && pthread_equal(pthread_self(), BOStringTestAllocationsThread))
+    {
+        BOStringTestAllocationsCount++;
+    }
+}
+
+static NSUInteger BOStringTestCountAllocations(void (^block)(void))
+{
+    BOStringTestAllocationsThread = pthread_self();
+    BOStringTestAllocationsCount = 0;
+    malloc_logger = BOStringTestCountAllocation;
+    block();
+    malloc_logger = NULL;
+    return BOStringTestAllocationsCount;
+}
+#endif // defined(__APPLE__)
+
 
 SpecBegin(BOString)
 
@@ -471,6 +501,18 @@ describe(@"Ranged attributes", ^{
         expect(result).to.equal(testAttributedString);
     });
     
+    it(@"should be set on a kept attribute", ^{
+        NSAttributedString *result = [_testString makeString:^(BOStringMaker *make) {
+            BOStringAttribute *fontAttribute = make.font(testFont);
+            make.foregroundColor(testColor);
+            fontAttribute.range(testRange);
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:_testString attributes:@{NSForegroundColorAttributeName: testColor}];
+        [testAttributedString addAttribute:NSFontAttributeName value:testFont range:testRange];
+        expect(result).to.equal(testAttributedString);
+    });
+    
     it(@"should be set when using withRange", ^{
         NSAttributedString *result = [_testString makeString:^(BOStringMaker *make) {
             make.with.stringRange(^{
@@ -705,5 +747,471 @@ describe(@"Substring should highlight", ^{
         expect(result).to.equal(testAttributedString);
     });
 });
+
+describe(@"Catalog", ^{
+    __block NSString *stringsPath;
+    __block NSString *catalogPath;
+
+    beforeAll(^{
+        stringsPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"BOStringCatalogTest.strings"];
+        catalogPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"BOStringCatalogTest.bosc"];
+        [@{@"greeting": @"Hello, world", @"plain": @"Plain string", @"unicode": @"Привет"} writeToFile:stringsPath atomically:YES];
+        [BOStringCatalog writeCatalogWithStringsFiles:@[stringsPath]
+                                        templateNames:@{@"greeting": @"title", @"unicode": @"title"}
+                                               toFile:catalogPath
+                                                error:nil];
+    });
+
+    it(@"should be loaded", ^{
+        NSError *error = nil;
+        BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:catalogPath error:&error];
+        expect(error).to.beNil();
+        expect(catalog.count).to.equal(3);
+        expect([catalog plainStringForKey:@"unicode"]).to.equal(@"Привет");
+        expect([catalog plainStringForKey:@"missing"]).to.beNil();
+    });
+
+    it(@"should style strings with registered template", ^{
+        BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:catalogPath error:nil];
+        [catalog registerTemplate:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor greenColor]);
+        } withName:@"title"];
+
+        NSAttributedString *testAttributedString = [[NSAttributedString alloc] initWithString:@"Hello, world" attributes:@{NSForegroundColorAttributeName: [BOSColor greenColor]}];
+        expect(catalog[@"greeting"]).to.equal(testAttributedString);
+        expect(catalog[@"greeting"]).to.beIdenticalTo(catalog[@"greeting"]);
+        expect(catalog[@"plain"]).to.equal([[NSAttributedString alloc] initWithString:@"Plain string"]);
+    });
+
+    it(@"should not cache strings made with a replaced template", ^{
+        BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:catalogPath error:nil];
+        __weak BOStringCatalog *weakCatalog = catalog;
+        [catalog registerTemplate:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor redColor]);
+            // template is replaced while a string is being made with it
+            [weakCatalog registerTemplate:^(BOStringMaker *make) {
+                make.foregroundColor([BOSColor greenColor]);
+            } withName:@"title"];
+        } withName:@"title"];
+
+        NSAttributedString *testAttributedString = [[NSAttributedString alloc] initWithString:@"Hello, world" attributes:@{NSForegroundColorAttributeName: [BOSColor greenColor]}];
+        expect([catalog[@"greeting"] attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL]).to.equal([BOSColor redColor]);
+        expect(catalog[@"greeting"]).to.equal(testAttributedString);
+    });
+
+    it(@"should return nil for nil key", ^{
+        BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:catalogPath error:nil];
+        NSString *key = nil;
+        expect([catalog stringForKey:key]).to.beNil();
+        expect([catalog plainStringForKey:key]).to.beNil();
+    });
+
+    it(@"should not load corrupted file", ^{
+        NSString *corruptedPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"BOStringCatalogCorrupted.bosc"];
+        [[@"not a catalog" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:corruptedPath atomically:YES];
+
+        NSError *error = nil;
+        BOStringCatalog *catalog = [[BOStringCatalog alloc] initWithContentsOfFile:corruptedPath error:&error];
+        expect(catalog).to.beNil();
+        expect(error.code).to.equal(BOStringCatalogCorruptedFileError);
+    });
+});
+
+describe(@"Nested rules", ^{
+    __block NSString *testString;
+    beforeAll(^{
+        testString = @"This is my string";
+    });
+
+    it(@"should be applied", ^{
+        NSAttributedString *result = [testString makeString:^(BOStringMaker *make) {
+            make.each.substring(@"is", ^{
+                make.foregroundColor([BOSColor greenColor]);
+                make.each.substring(@"s", ^{
+                    make.backgroundColor([BOSColor redColor]);
+                });
+            });
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(2, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(5, 2)];
+        [testAttributedString addAttribute:NSBackgroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(3, 1)];
+        [testAttributedString addAttribute:NSBackgroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(6, 1)];
+        [testAttributedString addAttribute:NSBackgroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(11, 1)];
+
+        expect(result).to.equal(testAttributedString);
+    });
+});
+
+describe(@"Conflicting attributes", ^{
+    __block NSString *testString;
+    beforeAll(^{
+        testString = @"This is my string";
+    });
+
+    it(@"should be resolved by call order", ^{
+        NSAttributedString *result = [testString makeString:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor blueColor]).range(NSMakeRange(1, 2));
+            make.foregroundColor([BOSColor redColor]).stringRange();
+            make.foregroundColor([BOSColor greenColor]).range(NSMakeRange(5, 2));
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString
+                                                                                                 attributes:@{NSForegroundColorAttributeName: [BOSColor redColor]}];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(5, 2)];
+
+        expect(result).to.equal(testAttributedString);
+    });
+
+    it(@"should be resolved by priority", ^{
+        NSAttributedString *result = [testString makeString:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor blueColor]).priority(1).range(NSMakeRange(1, 2));
+            make.priority(2, ^{
+                make.first.substring(@"my", ^{
+                    make.foregroundColor([BOSColor greenColor]);
+                });
+            });
+            make.foregroundColor([BOSColor redColor]).stringRange();
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString
+                                                                                                 attributes:@{NSForegroundColorAttributeName: [BOSColor redColor]}];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor blueColor] range:NSMakeRange(1, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(8, 2)];
+
+        expect(result).to.equal(testAttributedString);
+    });
+
+    it(@"should keep attributes with different names", ^{
+        NSAttributedString *result = [testString makeString:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor blueColor]).priority(1).range(NSMakeRange(0, 4));
+            make.backgroundColor([BOSColor redColor]).range(NSMakeRange(2, 4));
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor blueColor] range:NSMakeRange(0, 4)];
+        [testAttributedString addAttribute:NSBackgroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(2, 4)];
+
+        expect(result).to.equal(testAttributedString);
+    });
+});
+
+describe(@"Active window", ^{
+    __block NSString *testString;
+    beforeAll(^{
+        testString = @"ab ab ab ab ab";
+    });
+
+    it(@"should limit each rules", ^{
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:testString];
+        make.activeWindow = NSMakeRange(3, 5);
+        make.each.substring(@"ab", ^{
+            make.foregroundColor([BOSColor greenColor]);
+        });
+        make.foregroundColor([BOSColor redColor]).range(NSMakeRange(0, 1));
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(0, 1)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(3, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(6, 2)];
+        expect([make makeString]).to.equal(testAttributedString);
+    });
+
+    it(@"should style newly visible parts when extended", ^{
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:testString];
+        make.activeWindow = NSMakeRange(3, 5);
+        make.windowMargin = 2;
+        make.each.substring(@"ab", ^{
+            make.foregroundColor([BOSColor greenColor]);
+        });
+        make.foregroundColor([BOSColor redColor]).range(NSMakeRange(0, 4));
+        [make makeString];
+        [make extendActiveWindow:NSMakeRange(0, 10)];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(0, 4)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(4, 1)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(6, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(9, 2)];
+        expect([make makeString]).to.equal(testAttributedString);
+        expect(make.styledIndexes).to.equal([NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, 10)]);
+    });
+
+    it(@"should match word boundaries and anchors against the whole string", ^{
+        NSString *wordsString = @"abc def";
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:wordsString];
+        make.activeWindow = NSMakeRange(1, 6);
+        make.each.regexpMatch(@"\\b\\w+", 0, ^{
+            make.foregroundColor([BOSColor greenColor]);
+        });
+        make.each.regexpMatch(@"^\\w", 0, ^{
+            make.backgroundColor([BOSColor greenColor]);
+        });
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:wordsString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(4, 3)];
+        expect([make makeString]).to.equal(testAttributedString);
+    });
+
+    it(@"should run rules added after extension over the extended window", ^{
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:testString];
+        make.activeWindow = NSMakeRange(3, 5);
+        make.windowMargin = 2;
+        make.foregroundColor([BOSColor redColor]).range(NSMakeRange(0, 2));
+        [make extendActiveWindow:NSMakeRange(0, 10)];
+        make.each.substring(@"ab", ^{
+            make.backgroundColor([BOSColor greenColor]);
+        });
+        [make extendActiveWindow:NSMakeRange(0, [testString length])];
+
+        NSAttributedString *wholeString = [testString makeString:^(BOStringMaker *make) {
+            make.foregroundColor([BOSColor redColor]).range(NSMakeRange(0, 2));
+            make.each.substring(@"ab", ^{
+                make.backgroundColor([BOSColor greenColor]);
+            });
+        }];
+        expect([make makeString]).to.equal(wholeString);
+    });
+
+    it(@"should keep order of a replayed rule, which had no matches", ^{
+        NSString *shortString = @"ab ab";
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:shortString];
+        make.activeWindow = NSMakeRange(2, 1);
+        make.each.substring(@"ab", ^{
+            make.foregroundColor([BOSColor greenColor]);
+        });
+        make.foregroundColor([BOSColor redColor]);
+        [make extendActiveWindow:NSMakeRange(0, [shortString length])];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:shortString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(0, [shortString length])];
+        expect([make makeString]).to.equal(testAttributedString);
+    });
+
+    it(@"should stop after match limit", ^{
+        NSAttributedString *result = [testString makeString:^(BOStringMaker *make) {
+            make.each.limit(2).substring(@"ab", ^{
+                make.foregroundColor([BOSColor greenColor]);
+            });
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(0, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(3, 2)];
+        expect(result).to.equal(testAttributedString);
+    });
+});
+
+describe(@"Chrome trace sink", ^{
+    it(@"should write trace events", ^{
+        NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"BOStringTrace.json"];
+        BOStringChromeTraceSink *sink = [[BOStringChromeTraceSink alloc] initWithPath:path];
+        [sink beginPhase:BOStringTraceMatchEnumerationPhase rule:@"each.substring(\"a\")" timestamp:10];
+        [sink endPhase:BOStringTraceMatchEnumerationPhase rule:@"each.substring(\"a\")" timestamp:25];
+        [sink close];
+
+        NSArray *events = [NSJSONSerialization JSONObjectWithData:[NSData dataWithContentsOfFile:path] options:0 error:nil];
+        expect(events).to.haveCountOf(2);
+        expect(events[0][@"name"]).to.equal(@"match enumeration");
+        expect(events[0][@"ph"]).to.equal(@"B");
+        expect(events[0][@"args"][@"rule"]).to.equal(@"each.substring(\"a\")");
+        expect(events[1][@"ph"]).to.equal(@"E");
+        expect(events[1][@"ts"]).to.equal(@25);
+    });
+});
+
+describe(@"Syntax highlighting", ^{
+    NSString *source = @"if x \"if\" -- if\nreturn 42";
+    __block BOStringGrammar *grammar = nil;
+
+    beforeEach(^{
+        grammar = [[BOStringGrammar alloc] init];
+        grammar.keywords = @[@"if", @"return"];
+        grammar.lineCommentPrefixes = @[@"--"];
+        grammar.blockCommentDelimiters = @[@[@"--[[", @"]]"]];
+        grammar.stringDelimiters = @"\"";
+    });
+
+    it(@"should find tokens outside of strings and comments", ^{
+        NSMutableArray *tokens = [NSMutableArray array];
+        [grammar enumerateTokensInString:source usingBlock:^(BOStringTokenType type, NSRange range, BOOL *stop) {
+            [tokens addObject:@[@(type), [NSValue valueWithRange:range]]];
+        }];
+
+        expect(tokens).to.equal((@[@[@(BOStringKeywordToken), [NSValue valueWithRange:NSMakeRange(0, 2)]],
+                                   @[@(BOStringStringToken), [NSValue valueWithRange:NSMakeRange(5, 4)]],
+                                   @[@(BOStringCommentToken), [NSValue valueWithRange:NSMakeRange(10, 5)]],
+                                   @[@(BOStringKeywordToken), [NSValue valueWithRange:NSMakeRange(16, 6)]],
+                                   @[@(BOStringNumberToken), [NSValue valueWithRange:NSMakeRange(23, 2)]]]));
+    });
+
+    it(@"should prefer the longest delimiter and skip escaped characters", ^{
+        NSMutableArray *tokens = [NSMutableArray array];
+        [grammar enumerateTokensInString:@"--[[ a\n]] \"\\\"\" ifx" usingBlock:^(BOStringTokenType type, NSRange range, BOOL *stop) {
+            [tokens addObject:@[@(type), [NSValue valueWithRange:range]]];
+        }];
+
+        expect(tokens).to.equal((@[@[@(BOStringCommentToken), [NSValue valueWithRange:NSMakeRange(0, 9)]],
+                                   @[@(BOStringStringToken), [NSValue valueWithRange:NSMakeRange(10, 4)]]]));
+    });
+
+    it(@"should apply attributes to tokens", ^{
+        NSAttributedString *result = [source makeString:^(BOStringMaker *make) {
+            make.highlight(grammar, ^(BOStringTokenType type) {
+                if (type == BOStringKeywordToken)
+                {
+                    make.foregroundColor([BOSColor greenColor]);
+                }
+                if (type == BOStringCommentToken)
+                {
+                    make.foregroundColor([BOSColor redColor]);
+                }
+            });
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:source];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(0, 2)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(10, 5)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(16, 6)];
+        expect(result).to.equal(testAttributedString);
+    });
+});
+
+describe(@"Scoped string", ^{
+    NSString *testString = @"ab ab ab";
+
+    it(@"should keep command of a scope", ^{
+        NSAttributedString *result = [testString bos_makeScopedString:^(BOStringScope *make) {
+            BOStringScope *each = make.each;
+            make.last.substring(@"ab", ^{
+                make.foregroundColor([BOSColor redColor]);
+            });
+            each.substring(@"b", ^{
+                make.foregroundColor([BOSColor greenColor]);
+            });
+        }];
+
+        NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(1, 1)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(4, 1)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(6, 1)];
+        [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(7, 1)];
+        expect(result).to.equal(testAttributedString);
+    });
+
+    it(@"should record attributes set on one scope from several threads", ^{
+        NSString *longString = [@"" stringByPaddingToLength:512 withString:@"ab " startingAtIndex:0];
+        NSArray *colors = @[[BOSColor redColor], [BOSColor greenColor]];
+        for (NSUInteger i = 0; i < 20; i++)
+        {
+            NSAttributedString *result = [longString bos_makeScopedString:^(BOStringScope *make) {
+                dispatch_apply([longString length], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+                    make.foregroundColor(colors[index % 2]).range(NSMakeRange(index, 1));
+                });
+            }];
+
+            NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:longString];
+            for (NSUInteger index = 0; index < [longString length]; index++)
+            {
+                [testAttributedString addAttribute:NSForegroundColorAttributeName value:colors[index % 2] range:NSMakeRange(index, 1)];
+            }
+            expect(result).to.equal(testAttributedString);
+        }
+    });
+
+    it(@"should merge concurrent parts in their order", ^{
+        for (NSUInteger i = 0; i < 20; i++)
+        {
+            NSAttributedString *result = [testString bos_makeScopedString:^(BOStringScope *make) {
+                make.concurrently(@[^{
+                    make.each.substring(@"ab", ^{
+                        make.foregroundColor([BOSColor redColor]);
+                    });
+                }, ^{
+                    make.range(NSMakeRange(3, 5), ^{
+                        make.foregroundColor([BOSColor greenColor]);
+                    });
+                }]);
+            }];
+
+            NSMutableAttributedString *testAttributedString = [[NSMutableAttributedString alloc] initWithString:testString];
+            [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor redColor] range:NSMakeRange(0, 2)];
+            [testAttributedString addAttribute:NSForegroundColorAttributeName value:[BOSColor greenColor] range:NSMakeRange(3, 5)];
+            expect(result).to.equal(testAttributedString);
+        }
+    });
+});
+
+describe(@"Lazy string", ^{
+    NSString *testString = @"ab ab ab";
+
+    it(@"should be equal to eagerly made string", ^{
+        NSMutableAttributedString *initialString = [[NSMutableAttributedString alloc] initWithString:testString];
+        [initialString addAttribute:NSForegroundColorAttributeName value:[BOSColor blueColor] range:NSMakeRange(0, 8)];
+        BOStringMaker *make = [[BOStringMaker alloc] initWithAttributedString:initialString];
+        make.each.substring(@"b", ^{
+            make.foregroundColor([BOSColor greenColor]);
+        });
+        make.backgroundColor([BOSColor redColor]).range(NSMakeRange(2, 4));
+
+        NSAttributedString *result = [make makeLazyString];
+        expect(result).to.beKindOf([BOStringLazyAttributedString class]);
+        expect(result).to.equal([make makeString]);
+    });
+
+    it(@"should return effective range of attributes", ^{
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:testString];
+        make.foregroundColor([BOSColor greenColor]).range(NSMakeRange(0, 5));
+        make.backgroundColor([BOSColor redColor]).range(NSMakeRange(3, 5));
+        NSAttributedString *result = [make makeLazyString];
+
+        NSRange effectiveRange;
+        NSDictionary *attributes = [result attributesAtIndex:4 effectiveRange:&effectiveRange];
+        expect(attributes).to.equal((@{NSForegroundColorAttributeName: [BOSColor greenColor],
+                                       NSBackgroundColorAttributeName: [BOSColor redColor]}));
+        expect(NSEqualRanges(effectiveRange, NSMakeRange(3, 2))).to.beTruthy();
+
+        attributes = [result attributesAtIndex:6 effectiveRange:&effectiveRange];
+        expect(attributes).to.equal((@{NSBackgroundColorAttributeName: [BOSColor redColor]}));
+        expect(NSEqualRanges(effectiveRange, NSMakeRange(5, 3))).to.beTruthy();
+        expect([result copy]).to.beIdenticalTo(result);
+    });
+
+    it(@"should be archived as a plain attributed string", ^{
+        BOStringMaker *make = [[BOStringMaker alloc] initWithString:testString];
+        make.foregroundColor([BOSColor greenColor]).range(NSMakeRange(0, 5));
+        NSAttributedString *result = [make makeLazyString];
+
+        NSData *data = [NSKeyedArchiver archivedDataWithRootObject:result];
+        NSAttributedString *unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+        expect(unarchived).to.equal(result);
+        expect(unarchived).notTo.beKindOf([BOStringLazyAttributedString class]);
+    });
+});
+
+#if defined(__APPLE__)
+describe(@"Allocations", ^{
+    it(@"should allocate only an attribute object per setter call", ^{
+        NSUInteger attributesCount = 10000;
+        NSString *string = @"Test string.";
+        BOSColor *color = [BOSColor redColor];
+        __block NSUInteger allocationsCount = 0;
+        [string makeString:^(BOStringMaker *make) {
+            make.foregroundColor(color);
+            allocationsCount = BOStringTestCountAllocations(^{
+                @autoreleasepool {
+                    for (NSUInteger i = 0; i < attributesCount; i++)
+                    {
+                        make.foregroundColor(color);
+                    }
+                }
+            });
+        }];
+        // buffers and autorelease pool pages grow geometrically or in big chunks
+        expect(allocationsCount).to.beLessThan(attributesCount + 256);
+    });
+});
+#endif // defined(__APPLE__)
 SpecEnd
 